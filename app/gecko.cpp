@@ -1,5 +1,10 @@
 #include <fstream>
 #include <iostream>
+#include <thread>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <unistd.h>
+#endif
 
 #include "tokenizer/tokenizer.hpp"
 #include "parser/parser.hpp"
@@ -17,14 +22,43 @@ enum ReturnCodes
 
 int main(int argc, char ** argv)
 {
-    if( argc != 2 ) {
+    const auto option = ( argc == 3 ) ? std::string {argv[1]} : std::string {};
+
+    // Execute instruction objects instead of bytecode, for comparison
+    const auto reference = ( option == "--reference" );
+
+    // Count executions and cycles per instruction
+    const auto profile = ( option == "--profile" );
+
+    // Sample call stacks, report per source line and write FILENAME.folded for flame graphs
+    const auto sample = ( option == "--sample" );
+
+    // Collect garbage at loop back-edges and function returns, not only where the program says free
+    const auto autoGc = ( option == "--auto-gc" );
+
+    // As --auto-gc, but collect the arena in short slices instead of pausing for all of it
+    const auto incrementalGc = ( option == "--incremental-gc" );
+
+    // Mark and sweep large heaps on all cores
+    const auto parallelGc = ( option == "--parallel-gc" );
+
+    // Move long-lived objects next to each other once the heap is mostly empty
+    const auto compactGc = ( option == "--compact-gc" );
+
+    // Record allocations per instruction and pauses for garbage collection, write FILENAME.heap.json
+    const auto heapStats = ( option == "--heap-stats" );
+
+    // Read and split stdin on a separate thread while the program runs
+    const auto readAhead = ( option == "--read-ahead" );
 
-        std::cerr << "Need exactly one filename as argument\n";
+    if( argc != 2 && ! reference && ! profile && ! sample && ! autoGc && ! incrementalGc && ! parallelGc && ! compactGc && ! heapStats && ! readAhead ) {
+
+        std::cerr << "Usage: gecko [--reference | --profile | --sample | --auto-gc | --incremental-gc | --parallel-gc | --compact-gc | --heap-stats | --read-ahead] FILENAME\n";
 
         return InvalidNumArgs;
     }
 
-    const auto filename = argv[1];
+    const auto filename = argv[argc - 1];
     std::ifstream stream;
     stream.open(filename, std::ios::in);
     if( ! stream.is_open() ) {
@@ -38,7 +72,7 @@ int main(int argc, char ** argv)
 
     std::unique_ptr<ast::Scope> tree;
 
-    ct::Compiler compiler;
+    ct::Compiler compiler(( autoGc || incrementalGc ) ? ct::Compiler::GarbageCollection::Automatic : ct::Compiler::GarbageCollection::Explicit);
 
     try {
         Tokenizer tokenizer;
@@ -71,7 +105,55 @@ int main(int argc, char ** argv)
     }
 
     std::cout << "*** Program output ***\n";
-    run(compiler.instructions(), compiler.numObjectIdsUsed());
+    Executor executor;
+    if( incrementalGc ) executor.memory().setSliceBudget({0, std::chrono::microseconds {100}});
+    if( parallelGc ) executor.memory().setCollectorThreads(std::thread::hardware_concurrency());
+    if( compactGc ) executor.memory().setCompaction(true);
+    if( readAhead ) executor.input().setReadAhead(8);
+#if defined(__unix__) || defined(__APPLE__)
+    // Someone types the input, and wants to see the output of every line before typing the next one
+    if( isatty(STDIN_FILENO) ) executor.output().setLineBuffered(true);
+#endif
+    try {
+        if( reference ) {
+            executor.run(compiler.mainFunction());
+        } else if( profile ) {
+            const auto program = compiler.program();
+            Profiler profiler(program);
+            executor.run(program, profiler);
+            std::cout << "*** Profile ***\n";
+            profiler.report(std::cout);
+        } else if( sample ) {
+            const auto program = compiler.program();
+            Sampler sampler(program);
+            executor.run(program, sampler);
+            std::cout << "*** Samples per line ***\n";
+            sampler.reportLines(std::cout, code);
+
+            const auto foldedFilename = std::string {filename} + ".folded";
+            std::ofstream folded(foldedFilename);
+            sampler.reportFolded(folded);
+            std::cout << "Call stacks written to " << foldedFilename << "\n";
+        } else if( heapStats ) {
+            const auto program = compiler.program();
+            HeapStatistics statistics(&program);
+            executor.run(program, statistics);
+
+            const auto jsonFilename = std::string {filename} + ".heap.json";
+            std::ofstream json(jsonFilename);
+            statistics.writeJson(json, executor.memory().census());
+            std::cout << "Heap statistics written to " << jsonFilename << "\n";
+        } else {
+            executor.run(compiler.program());
+        }
+    } catch(const ProgammingError & e) {
+        std::cout << "**********************\n";
+        std::cerr << e.name() << " at line " << e.mPosition.lineNumber << ", column " << e.mPosition.column << ": "
+                  << e.what()
+                  << "\n";
+
+        return ReturnCodes::ProgrammingError;
+    }
     std::cout << "**********************\n";
 
     return OK;
@@ -0,0 +1,320 @@
+#include "compiler/compiler.hpp"
+#include "parser/parser.hpp"
+#include "runtime/executor.hpp"
+#include "runtime/profiler.hpp"
+#include "tokenizer/tokenizer.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__GLIBC__)
+    #include <malloc.h>
+#endif
+
+
+// Heap usage of the whole process, tracked by replacing the global allocation functions
+namespace {
+
+    std::atomic<size_t> heapInUse {0};
+    std::atomic<size_t> heapPeak {0};
+
+    void * allocate(size_t size)
+    {
+        auto ptr = std::malloc(size ? size : 1);
+        if( ! ptr ) throw std::bad_alloc {};
+#if defined(__GLIBC__)
+        const auto inUse = heapInUse += malloc_usable_size(ptr);
+        auto peak = heapPeak.load();
+        while( inUse > peak && ! heapPeak.compare_exchange_weak(peak, inUse) ) {}
+#endif
+        return ptr;
+    }
+
+    void deallocate(void * ptr)
+    {
+        if( ! ptr ) return;
+#if defined(__GLIBC__)
+        heapInUse -= malloc_usable_size(ptr);
+#endif
+        std::free(ptr);
+    }
+
+}
+
+void * operator new(size_t size) { return allocate(size); }
+void * operator new[](size_t size) { return allocate(size); }
+void operator delete(void * ptr) noexcept { deallocate(ptr); }
+void operator delete[](void * ptr) noexcept { deallocate(ptr); }
+void operator delete(void * ptr, size_t) noexcept { deallocate(ptr); }
+void operator delete[](void * ptr, size_t) noexcept { deallocate(ptr); }
+
+
+namespace {
+
+    enum ReturnCodes
+    {
+        OK,
+        InvalidArgs,
+        CouldNotOpenFile,
+        Regression,
+    };
+
+    const char * const phases[] = {"tokenize", "parse", "compile", "assemble", "run"};
+
+    struct Workload
+    {
+        std::string name;
+        /// Relative to the source directory
+        std::string path;
+        /// Fed to stdin
+        std::function<std::string()> input = [] { return std::string {}; };
+    };
+
+    const std::vector<Workload> & workloads()
+    {
+        static const std::vector<Workload> ret = {
+            {"speed_test_operator", "examples/speed_test_operator.gecko"},
+            {"speed_test_function", "examples/speed_test_function.gecko"},
+            {"lists", "bench/workloads/lists.gecko"},
+            {"strings", "bench/workloads/strings.gecko", [] {
+                std::string input;
+                for(int i = 0; i < 200000; i++) input += "string number " + std::to_string(i) + "\n";
+                return input;
+            }},
+            {"stdin", "bench/workloads/stdin.gecko", [] {
+                std::string input;
+                for(int i = 0; i < 200000; i++) input += "line " + std::to_string(i) + "\n";
+                return input;
+            }},
+            {"calls", "bench/workloads/calls.gecko"},
+            {"gc", "bench/workloads/gc.gecko"},
+        };
+
+        return ret;
+    }
+
+    struct Result
+    {
+        std::string name;
+        uint64_t instructions = 0;
+        /// Best of all repetitions
+        std::map<std::string, double> seconds;
+        /// Growth of the heap during the phase, over all repetitions
+        std::map<std::string, size_t> peakHeap;
+    };
+
+    std::string readFile(const std::string & path)
+    {
+        std::ifstream stream(path);
+        if( ! stream.is_open() ) {
+
+            throw std::runtime_error("Could not open " + path);
+        }
+
+        return { std::istreambuf_iterator<char>(stream), {} };
+    }
+
+    Result measure(const Workload & workload, const std::string & sourceDir, int repetitions)
+    {
+        Result result;
+        result.name = workload.name;
+
+        const auto code = readFile(sourceDir + "/" + workload.path);
+        const auto input = workload.input();
+
+        // Reused like in a service which runs the same script many times
+        std::ostringstream output;
+        Executor executor(std::cin, output);
+
+        for(int repetition = 0; repetition < repetitions; repetition++) {
+
+            const auto phase = [&](const char * name, const std::function<void()> & fn) {
+                const auto heapBefore = heapInUse.load();
+                heapPeak = heapBefore;
+                const auto start = std::chrono::steady_clock::now();
+                fn();
+                const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+                auto & seconds = result.seconds[name];
+                seconds = repetition ? std::min(seconds, elapsed.count()) : elapsed.count();
+                auto & peak = result.peakHeap[name];
+                peak = std::max(peak, heapPeak.load() - heapBefore);
+            };
+
+            std::vector<Token> tokens;
+            phase("tokenize", [&] { tokens = Tokenizer().tokenize(code); });
+
+            std::unique_ptr<ast::Scope> tree;
+            phase("parse", [&] {
+                auto it = tokens.cbegin();
+                tree = parseScope(it, tokens.cend(), 0);
+            });
+
+            ct::Compiler compiler;
+            phase("compile", [&] { tree->acceptVisitor(compiler); });
+
+            bc::Program program;
+            phase("assemble", [&] { program = compiler.program(); });
+
+            std::istringstream stdinStream(input);
+            executor.setInput(stdinStream);
+            output.str({});
+            phase("run", [&] { executor.run(program); });
+
+            // Count instructions in a separate run, counting slows down execution
+            if( repetition == 0 ) {
+                std::istringstream stdinStream(input);
+                executor.setInput(stdinStream);
+                output.str({});
+                Profiler profiler(program, false);
+                executor.run(program, profiler);
+                result.instructions = profiler.totalCount();
+            }
+
+            // Objects of the program are not part of the next measurement
+            executor.reset();
+        }
+
+        return result;
+    }
+
+    void writeJson(std::ostream & stream, const std::vector<Result> & results)
+    {
+        stream << "{\n  \"workloads\": [\n";
+        for(size_t i = 0; i < results.size(); i++) {
+            const auto & result = results[i];
+            const auto run = result.seconds.at("run");
+
+            // One workload per line s.t. baselines can be compared line by line
+            stream << "    {\"name\": \"" << result.name << "\", "
+                   << "\"instructions\": " << result.instructions << ", "
+                   << "\"instructions_per_second\": " << std::fixed << std::setprecision(0)
+                   << ( run > 0 ? result.instructions / run : 0.0 ) << ", "
+                   << "\"seconds\": {";
+            for(size_t j = 0; j < std::size(phases); j++) {
+                stream << ( j ? ", " : "" ) << "\"" << phases[j] << "\": "
+                       << std::scientific << std::setprecision(6) << result.seconds.at(phases[j]);
+            }
+            stream << "}, \"peak_heap_bytes\": {";
+            for(size_t j = 0; j < std::size(phases); j++) {
+                stream << ( j ? ", " : "" ) << "\"" << phases[j] << "\": " << result.peakHeap.at(phases[j]);
+            }
+            stream << "}}" << ( i + 1 < results.size() ? "," : "" ) << "\n";
+        }
+        stream << "  ]\n}\n";
+    }
+
+    /// Run time of a workload in a file written by writeJson, negative if not found
+    double baselineRunTime(const std::string & json, const std::string & name)
+    {
+        const auto start = json.find("{\"name\": \"" + name + "\"");
+        if( start == std::string::npos ) return -1;
+
+        const std::string key = "\"run\": ";
+        const auto found = json.find(key, start);
+        if( found == std::string::npos || found > json.find('\n', start) ) return -1;
+
+        return std::stod(json.substr(found + key.size()));
+    }
+
+    void printSummary(std::ostream & stream, const std::vector<Result> & results)
+    {
+        stream << std::left << std::setw(22) << "workload" << std::right;
+        for(const auto phase : phases) stream << std::setw(12) << phase;
+        stream << std::setw(14) << "MInstr/s" << std::setw(14) << "peak heap" << "\n";
+
+        for(const auto & result : results) {
+            const auto run = result.seconds.at("run");
+            stream << std::left << std::setw(22) << result.name << std::right << std::fixed << std::setprecision(4);
+            for(const auto phase : phases) stream << std::setw(12) << result.seconds.at(phase);
+            stream << std::setw(14) << std::setprecision(1) << ( run > 0 ? result.instructions / run / 1e6 : 0.0 )
+                   << std::setw(14) << result.peakHeap.at("run") << "\n";
+        }
+    }
+
+}
+
+
+int main(int argc, char ** argv)
+{
+    std::string sourceDir = GECKO_SOURCE_DIR;
+    std::string outputFile, baselineFile;
+    int repetitions = 3;
+    double tolerance = 0.1;
+
+    const std::string usage = "Usage: gecko_bench [--output FILE.json] [--baseline FILE.json] [--tolerance FRACTION] [--repetitions N] [--source-dir DIR]\n";
+    for(int i = 1; i < argc; i++) {
+        const std::string option = argv[i];
+        if( i + 1 == argc ) {
+            std::cerr << usage;
+
+            return InvalidArgs;
+        }
+        const std::string value = argv[++i];
+
+        if( option == "--output" ) outputFile = value;
+        else if( option == "--baseline" ) baselineFile = value;
+        else if( option == "--tolerance" ) tolerance = std::stod(value);
+        else if( option == "--repetitions" ) repetitions = std::max(1, std::stoi(value));
+        else if( option == "--source-dir" ) sourceDir = value;
+        else {
+            std::cerr << usage;
+
+            return InvalidArgs;
+        }
+    }
+
+    std::vector<Result> results;
+    try {
+        for(const auto & workload : workloads()) {
+            results.push_back(measure(workload, sourceDir, repetitions));
+        }
+    } catch(const std::runtime_error & e) {
+        std::cerr << e.what() << "\n";
+
+        return CouldNotOpenFile;
+    }
+
+    printSummary(std::cerr, results);
+
+    if( outputFile.empty() ) {
+        writeJson(std::cout, results);
+    } else {
+        std::ofstream stream(outputFile);
+        writeJson(stream, results);
+    }
+
+    if( baselineFile.empty() ) return OK;
+
+    std::string baseline;
+    try {
+        baseline = readFile(baselineFile);
+    } catch(const std::runtime_error & e) {
+        std::cerr << e.what() << "\n";
+
+        return CouldNotOpenFile;
+    }
+
+    auto ret = OK;
+    for(const auto & result : results) {
+        const auto before = baselineRunTime(baseline, result.name);
+        const auto now = result.seconds.at("run");
+        if( before > 0 && now > before * (1 + tolerance) ) {
+            std::cerr << "Regression in " << result.name << ": " << before << "s -> " << now << "s\n";
+            ret = Regression;
+        }
+    }
+
+    return ret;
+}
@@ -107,6 +107,18 @@ public:
 };
 
 
+/// Step of a range which is not positive, found at compile time or when the loop starts
+class InvalidStep: public ProgammingError
+{
+public:
+    InvalidStep(const Position & position, int64_t step)
+        : ProgammingError(position, "Step of range must be positive, got " + std::to_string(step))
+    {}
+
+    const char * name() const override { return "InvalidStep"; }
+};
+
+
 class CompileError: public ProgammingError
 {
 public:
@@ -6,14 +6,17 @@
 #include "functions/stdin.hpp"
 #include "functions/userfunction.hpp"
 #include "compiletimeobject.hpp"
+#include "runtime/memorymanager.hpp"
 
-#include<memory>
+#include <cstring>
+#include <memory>
 #include <sstream>
 
 
 namespace ct {
 
-Compiler::Compiler()
+Compiler::Compiler(GarbageCollection collection)
+    : mGarbageCollection(collection)
 {
     loadPrelude();
 }
@@ -23,8 +26,41 @@ const InstructionVector &Compiler::instructions() const
     return mInstructions;
 }
 
+FunctionCode Compiler::mainFunction() const
+{
+    auto instructions = mInstructions;
+    finishSafepoints(instructions);
+
+    return FunctionCode {"main", std::move(instructions), mObjectProvider.numObjectsIssued(), 0, mConstants, mPositions};
+}
+
+bc::Program Compiler::program() const
+{
+    return bc::assemble(mainFunction());
+}
+
 void Compiler::visitAddition(const ast::Addition & addition)
 {
+    // Adding an integer literal does not need an object for the literal
+    const ast::Expression * operand = addition.mLeft.get();
+    auto literal = dynamic_cast<const ast::IntLiteral*>(addition.mRight.get());
+    if( ! literal ) {
+        operand = addition.mRight.get();
+        literal = dynamic_cast<const ast::IntLiteral*>(addition.mLeft.get());
+    }
+    if( literal ) {
+        operand->acceptVisitor(*this);
+        const auto lhs = latestObject;
+        if( lhs->type != BasicType::INT ) {
+            throw TypeMismatch(addition.position(), ""); // TODO: mPosition, text
+        }
+
+        latestObject = mObjectProvider.createObject(lhs->type);
+        appendInstruction<ins::AddIntImmediate>(lhs->id, literal->mValue, latestObject->id);
+
+        return;
+    }
+
     addition.mLeft->acceptVisitor(*this);
     const auto lhs = latestObject;
     addition.mRight->acceptVisitor(*this);
@@ -42,6 +78,7 @@ void Compiler::visitAddition(const ast::Addition & addition)
 
 void Compiler::visitAssignment(const ast::Assignment &assignment)
 {
+    const auto ipStartOfValue = mInstructions.size();
     assignment.mValue->acceptVisitor(*this);
     const auto source = latestObject;
 
@@ -55,6 +92,25 @@ void Compiler::visitAssignment(const ast::Assignment &assignment)
     }
     destination->type = source->type;
 
+    if( destination->depth != mObjectProvider.depth() ) {
+        if( destination->depth != 0 ) {
+            throw UndefinedVariable(name->position(), name->mName + " belongs to enclosing function");
+        }
+        appendInstruction<ins::StoreGlobal>(source->id, destination->id);
+        latestObject = source;
+
+        return;
+    }
+
+    // Let the instruction which computed the value write directly to the destination
+    if( mInstructions.size() > ipStartOfValue ) {
+        if( auto retargeted = mInstructions.back()->retarget(source->id, destination->id) ) {
+            mInstructions.back() = retargeted;
+
+            return;
+        }
+    }
+
     appendInstruction<ins::Copy>(source->id, destination->id);
 }
 
@@ -86,34 +142,81 @@ void Compiler::visitFunctionCall(const ast::FunctionCall &functionCall)
 
 void Compiler::visitFunctionDefinition(const ast::FunctionDefinition & def)
 {
+    // Compile body into a function of its own, with dedicated objects and literals
+    ObjectProvider objectProvider(mObjectProvider.depth() + 1);
+    InstructionVector instructions;
+    std::vector<SourcePosition> positions;
+    auto constants = std::make_shared<ConstantPool>();
+    decltype(mLiterals) literals;
+    decltype(mStringLiterals) stringLiterals;
+    bool collectsGarbage = false;
+    std::vector<InstructionPointer> safepoints;
+    const auto latestObjectOfCaller = latestObject;
+    const auto swapFunction = [&] {
+        std::swap(objectProvider, mObjectProvider);
+        std::swap(instructions, mInstructions);
+        std::swap(positions, mPositions);
+        std::swap(constants, mConstants);
+        std::swap(literals, mLiterals);
+        std::swap(stringLiterals, mStringLiterals);
+        std::swap(collectsGarbage, mCollectsGarbage);
+        std::swap(safepoints, mSafepoints);
+    };
+    swapFunction();
+
     std::vector<Type> argumentTypes;
-    std::vector<std::shared_ptr<CompileTimeObject> > argumentSlots;
 
     // Special scope for arguments
     mLookup.push();
 
+    // Arguments are the first objects, see FunctionCode
     for(const auto & pair : def.mArguments) {
         lookupType(*pair.second);
         argumentTypes.push_back(latestType);
-        lookupOrCreate(pair.first->mName);
-        latestObject->type = latestType;
-        argumentSlots.push_back(latestObject);
+        mLookup.setObject(pair.first->mName, mObjectProvider.createObject(latestType));
     }
 
-    InstructionVector instructions;
-    instructions.push_back(std::make_shared<ins::MemPush>());
+    appendInstruction<ins::Noop>(); // Placeholder for MemPush
 
-    // Compile body, but store instructions in a dedicated vector
-    std::swap(instructions, mInstructions);
+    latestObject = nullptr;
     def.mBody->acceptVisitor(*this);
-    const auto returnObject = latestObject; // Last object touched by function is return value
-    std::swap(instructions, mInstructions);
-
-    instructions.push_back(std::make_shared<ins::MemPop>());
+    auto returnObject = latestObject; // Last object touched by function is return value
+    if( ! returnObject || returnObject->depth != mObjectProvider.depth() ) {
+        returnObject = mObjectProvider.createObject();
+    }
 
+    // If nothing the function allocates can be reached after it returns except through the return value,
+    // everything else is deleted at once and there is no need for a safepoint at its return.
+    // Otherwise, objects of the caller must survive garbage collection within the function.
+    // Without loops, a function allocates too little to be worth a safepoint at its return
+    const EscapeAnalysis escapeAnalysis(mInstructions, mObjectProvider.numObjectsIssued(), def.mArguments.size());
+    if( ! escapeAnalysis.escapes() && escapeAnalysis.allocates() ) {
+        std::vector<ObjectId> keep;
+        if( returnObject->isAllocated() ) keep.push_back(returnObject->id);
+        mInstructions.front() = std::make_shared<ins::MemPush>();
+        appendInstruction<ins::PopRegion>(keep);
+    } else if( mCollectsGarbage ) {
+        if( mGarbageCollection == GarbageCollection::Automatic ) appendSafepoint();
+        mInstructions.front() = std::make_shared<ins::MemPush>();
+        appendInstruction<ins::MemPop>();
+    }
+    appendInstruction<ins::Return>(returnObject->id);
 
+    finishSafepoints(mInstructions);
     mLookup.pop();
 
+    auto code = std::make_shared<FunctionCode>();
+    code->name = def.mName->mName;
+    code->instructions = std::move(mInstructions);
+    code->numObjects = mObjectProvider.numObjectsIssued();
+    code->numArguments = def.mArguments.size();
+    code->constants = mConstants;
+    code->positions = std::move(mPositions);
+    code->escapes = escapeAnalysis.escapes();
+
+    swapFunction();
+    latestObject = latestObjectOfCaller;
+
     const auto mTypeParameters = std::vector<Type> {}; // TODO: user functions with type parameters
 
     const auto functionKey = FunctionKey { def.mName->mName, {}, argumentTypes };
@@ -126,88 +229,195 @@ void Compiler::visitFunctionDefinition(const ast::FunctionDefinition & def)
 
     mLookup.setFunction(std::make_unique<ct::UserFunction>(
         functionKey,
-        std::move(argumentSlots),
-        returnObject,
-        std::move(instructions)
+        std::move(code),
+        returnObject->type
     ));
 }
 
 
 void Compiler::visitIntLiteral(const ast::IntLiteral &literal)
 {
-    latestObject = mObjectProvider.createObject(BasicType::INT);
-    appendInstruction<ins::SetInt>(latestObject->id, literal.mValue);
+    Object value {};
+    value.as_int = literal.mValue;
+    latestObject = this->literal(BasicType::INT, value);
 }
 
 void Compiler::visitFloatLiteral(const ast::FloatLiteral &literal)
 {
-    latestObject = mObjectProvider.createObject(BasicType::FLOAT);
-    appendInstruction<ins::SetFloat>(latestObject->id, literal.mValue);
+    Object value {};
+    value.as_float = literal.mValue;
+    latestObject = this->literal(BasicType::FLOAT, value);
 }
 
 void Compiler::visitFor(const ast::For &loop)
 {
+    if( auto range = dynamic_cast<const ast::Range*>(loop.mRange.get()) ) {
+        visitCountingFor(loop, *range);
+
+        return;
+    }
+
     loop.mRange->acceptVisitor(*this);
     const auto range = latestObject;
 
     auto nextFn = lookupFunction("next", {}, {range->type}, loop.mRange->position());
 
-    auto optional = mObjectProvider.createObject();
-
     // // Create new address & special scope for loop var:
     auto loopVar = mObjectProvider.createObject();
     mLookup.push();
     mLookup.setObject(loop.mLoopVariable->mName, loopVar);
 
-    auto expectedEnumKey = mObjectProvider.createObject(BasicType::INT);
-    appendInstruction<ins::SetInt>(expectedEnumKey->id, 1);
-
-    // nextFn
-    const auto ipNext = latestInstructionPointer() + 1;
-    nextFn->generateInstructions({}, {range}, mInstructions, optional);
-    loopVar->type = getOptionalType(mTypeCreator, optional->type);
+    Object one {};
+    one.as_int = 1;
+    auto expectedEnumKey = literal(BasicType::INT, one);
 
     // // TODO: Visit enum
     auto enumKey = mObjectProvider.createObject(BasicType::INT);
-    appendInstruction<ins::ReadFromTuple<0, 2> >(optional->id, enumKey->id);
+
+    // nextFn. If it can hand out the optional in the loop variable and the enum key directly,
+    // iterating does not allocate
+    const auto ipNext = latestInstructionPointer() + 1;
+    const auto unboxed = nextFn->generateUnboxedOptional({}, {range}, mInstructions, enumKey, loopVar);
+    std::shared_ptr<CompileTimeObject> optional;
+    if( ! unboxed ) {
+        optional = mObjectProvider.createObject();
+        nextFn->generateInstructions({}, {range}, mInstructions, optional);
+        loopVar->type = getOptionalType(mTypeCreator, optional->type);
+        appendInstruction<ins::ReadFromTuple<0, 2> >(optional->id, enumKey->id);
+    }
+
     auto condition = mObjectProvider.createObject(BasicType::BOOLEAN);
+    const auto ipStartOfCondition = latestInstructionPointer() + 1;
     appendInstruction<ins::IsEqual>(enumKey->id, expectedEnumKey->id, condition->id);
 
-    appendInstruction<ins::Noop>(); // placeholder for jump_if
-    const auto ipJumpIfNot = latestInstructionPointer();
+    const auto ipJumpIfNot = appendJumpIfNotPlaceholder(*condition, ipStartOfCondition);
 
     // Now we are in the section where optional has value
-    appendInstruction<ins::ReadFromTuple<1, 2> >(optional->id, loopVar->id);
+    if( ! unboxed ) appendInstruction<ins::ReadFromTuple<1, 2> >(optional->id, loopVar->id);
 
     loop.mBody->acceptVisitor(*this);
+    if( mGarbageCollection == GarbageCollection::Automatic ) appendSafepoint();
     appendInstruction<ins::Jump>(ipNext);
 
     appendInstruction<ins::Noop>(); // Make sure there is something to jump to
     const auto afterLoop = latestInstructionPointer();
-    mInstructions[ipJumpIfNot] = std::make_unique<ins::JumpIfNot>(condition->id, afterLoop);
+    setJumpIfNot(ipJumpIfNot, *condition, afterLoop);
+
+    mLookup.pop();
+}
+
+void Compiler::visitCountingFor(const ast::For &loop, const ast::Range &range)
+{
+    // Start, end and step are evaluated once, into objects the body cannot assign to
+    const auto evaluate = [this](const ast::Expression & expression) {
+        expression.acceptVisitor(*this);
+        if( latestObject->type != BasicType::INT ) {
+            throw TypeMismatch(expression.position(), "Range bounds and step must be integers");
+        }
+        auto copy = mObjectProvider.createObject(BasicType::INT);
+        appendInstruction<ins::Copy>(latestObject->id, copy->id);
+
+        return copy;
+    };
+    const auto counter = evaluate(*range.mStart);
+    const auto end = evaluate(*range.mEnd);
+    std::shared_ptr<CompileTimeObject> step;
+    if( range.mStep ) {
+        // A step which is not positive would never reach the end
+        const auto literalStep = dynamic_cast<const ast::IntLiteral*>(range.mStep.get());
+        if( literalStep && literalStep->mValue <= 0 ) throw InvalidStep(range.mStep->position(), literalStep->mValue);
+
+        step = evaluate(*range.mStep);
+        if( ! literalStep ) appendInstruction<ins::CheckStep>(step->id, range.mStep->position());
+    } else {
+        Object one {};
+        one.as_int = 1;
+        step = literal(BasicType::INT, one);
+    }
+
+    auto loopVar = mObjectProvider.createObject(BasicType::INT);
+    mLookup.push();
+    mLookup.setObject(loop.mLoopVariable->mName, loopVar);
+
+    // The condition is checked once before, and then at the end of every iteration
+    appendInstruction<ins::Noop>();
+    const auto ipGuard = latestInstructionPointer();
+
+    // Assigning to the loop variable does not change how often the loop runs
+    appendInstruction<ins::Copy>(counter->id, loopVar->id);
+    const auto ipStartOfBody = latestInstructionPointer();
+
+    loop.mBody->acceptVisitor(*this);
+    if( mGarbageCollection == GarbageCollection::Automatic ) appendSafepoint();
+    appendInstruction<ins::AddIntJumpIfLessThan>(counter->id, step->id, end->id, counter->id, ipStartOfBody);
+
+    appendInstruction<ins::Noop>(); // Make sure there is something to jump to
+    const auto afterLoop = latestInstructionPointer();
+    mInstructions[ipGuard] = std::make_shared<ins::JumpIfNotIntLessThan>(counter->id, end->id, afterLoop);
 
     mLookup.pop();
 }
 
 void Compiler::visitFree()
 {
-    std::vector<ObjectId> objectsInUse;
+    // Safepoints keep temporaries alive as well, which the scopes below do not know of
+    if( mGarbageCollection == GarbageCollection::Automatic ) {
+        appendSafepoint(true);
+
+        return;
+    }
+
+    // Objects of enclosing functions are protected by their barrier, see MemPush
+    std::vector<ObjectId> objectsInUse, globalsInUse;
     for(const auto & scope : mLookup.scopes()) {
         for( const auto & pair : scope.mObjects ) {
             const auto & object = pair.second;
             if( object->isAllocated() ) {
-                objectsInUse.push_back(object->id);
+                if( object->depth == mObjectProvider.depth() ) {
+                    objectsInUse.push_back(object->id);
+                } else if( object->depth == 0 ) {
+                    globalsInUse.push_back(object->id);
+                }
+            }
+        }
+    }
+
+    mCollectsGarbage = true;
+    appendInstruction<ins::CollectGarbage>(objectsInUse, globalsInUse);
+}
+
+void Compiler::appendSafepoint(bool always)
+{
+    mCollectsGarbage = true;
+    mSafepoints.push_back(mInstructions.size());
+    appendInstruction<ins::Safepoint>(always);
+}
+
+void Compiler::finishSafepoints(InstructionVector & instructions) const
+{
+    // Functions can store objects they allocate into globals, see StoreGlobal
+    std::vector<ObjectId> globals;
+    if( mObjectProvider.depth() > 0 ) {
+        for(const auto & scope : mLookup.scopes()) {
+            for( const auto & pair : scope.mObjects ) {
+                const auto & object = pair.second;
+                if( object->isAllocated() && object->depth == 0 ) globals.push_back(object->id);
             }
         }
     }
 
-    appendInstruction<ins::CollectGarbage>(objectsInUse);
+    const auto roots = mObjectProvider.allocatedObjects();
+    for(const auto ip : mSafepoints) {
+        const auto & safepoint = static_cast<const ins::Safepoint &>(*instructions.at(ip));
+        instructions[ip] = safepoint.withRoots(roots, globals);
+    }
 }
 
 void Compiler::visitBooleanLiteral(const ast::BooleanLiteral &literal)
 {
-    latestObject = mObjectProvider.createObject(BasicType::BOOLEAN);
-    appendInstruction<ins::SetBoolean>(latestObject->id, literal.mValue);
+    Object value {};
+    value.as_boolean = literal.mValue;
+    latestObject = this->literal(BasicType::BOOLEAN, value);
 }
 
 void Compiler::visitComparison(const ast::Comparison &visitable)
@@ -274,6 +484,15 @@ void Compiler::visitComparison(const ast::Comparison &visitable)
 void Compiler::visitName(const ast::Name &name)
 {
     lookupObject(name); // sets latest object id
+
+    const auto object = latestObject;
+    if( object->depth != mObjectProvider.depth() ) {
+        if( object->depth != 0 ) {
+            throw UndefinedVariable(name.position(), name.mName + " belongs to enclosing function");
+        }
+        latestObject = mObjectProvider.createObject(object->type);
+        appendInstruction<ins::LoadGlobal>(object->id, latestObject->id);
+    }
 }
 
 
@@ -292,6 +511,7 @@ void Compiler::visitScope(const ast::Scope &scope)
 {
     mLookup.push();
     for(auto & statement : scope.mStatements) {
+        setPosition(statement->position());
         statement->acceptVisitor(*this);
     }
     mLookup.pop();
@@ -299,8 +519,13 @@ void Compiler::visitScope(const ast::Scope &scope)
 
 void Compiler::visitStringLiteral(const ast::StringLiteral &visitable)
 {
-    latestObject = mObjectProvider.createObject(BasicType::STRING);
-    appendInstruction<ins::SetString>(latestObject->id, visitable.mValue);
+    auto & object = mStringLiterals[visitable.mValue];
+    if( ! object ) {
+        object = mObjectProvider.createObject(BasicType::STRING);
+        mConstants->addString(object->id, visitable.mValue);
+    }
+
+    latestObject = object;
 }
 
 void Compiler::visitType(const ast::Type &visitable)
@@ -309,6 +534,11 @@ void Compiler::visitType(const ast::Type &visitable)
 }
 
 
+void Compiler::visitRange(const ast::Range & /* range */)
+{
+    throw MissingFeature("Ranges outside of for loops");
+}
+
 void Compiler::visitWhile(const ast::While &loop)
 {
     const auto ipStartOfCondition = latestInstructionPointer() + 1;
@@ -319,36 +549,37 @@ void Compiler::visitWhile(const ast::While &loop)
         throw TypeMismatch(loop.position(), "While condition must be boolean"); // TODO: mPosition, text
     }
 
-    appendInstruction<ins::Noop>(); // placeholder for jump_if
-    const auto ipJumpIfNot = latestInstructionPointer();
+    const auto ipJumpIfNot = appendJumpIfNotPlaceholder(*condition, ipStartOfCondition);
 
     loop.mBody->acceptVisitor(*this);
+    if( mGarbageCollection == GarbageCollection::Automatic ) appendSafepoint();
     appendInstruction<ins::Jump>(ipStartOfCondition);
 
     appendInstruction<ins::Noop>(); // Make sure there is something to jump to
     const auto afterLoop = latestInstructionPointer();
-    mInstructions[ipJumpIfNot] = std::make_unique<ins::JumpIfNot>(condition->id, afterLoop);
+    setJumpIfNot(ipJumpIfNot, *condition, afterLoop);
 }
 
 
 
 void Compiler::visitIfThen(const ast::IfThen &ifThen)
 {
+    const auto ipStartOfCondition = latestInstructionPointer() + 1;
     ifThen.mCondition->acceptVisitor(*this);
     auto condition = latestObject;
     if( condition->type != BasicType::BOOLEAN ) {
         throw TypeMismatch(ifThen.mCondition->position(), "If-condition must be boolean");
     }
 
-    appendInstruction<ins::Noop>();
-    const auto ipJumpToEnd = latestInstructionPointer();  // Will hold instruction to jump to end
+    // Will hold instruction to jump to end
+    const auto ipJumpToEnd = appendJumpIfNotPlaceholder(*condition, ipStartOfCondition);
 
     ifThen.mIfBlock->acceptVisitor(*this);
 
     appendInstruction<ins::Noop>(); // This is the end
     const auto ipEnd = latestInstructionPointer();
 
-    mInstructions[ipJumpToEnd] = std::make_unique<ins::JumpIfNot>(condition->id, ipEnd);
+    setJumpIfNot(ipJumpToEnd, *condition, ipEnd);
 }
 
 void Compiler::visitIfThenElse(const ast::IfThenElse &ifThenElse)
@@ -417,9 +648,10 @@ void Compiler::loadPrelude()
 {
     registerBuiltinFunction<PrintInt>({"print", {}, {BasicType::INT}});
     registerBuiltinFunction<PrintString>({"print", {}, {BasicType::STRING}});
+    registerBuiltinFunction<AddInt>({"__add__", {}, {BasicType::INT, BasicType::INT}});
 
     lookupOrCreate({"stdin"}); // TODO: no need to lookup
-    appendInstruction<ins::SetAllocated>(latestObject->id, &std::make_unique<obj::Childless>);
+    appendInstruction<ins::SetAllocated>(latestObject->id, [](MemoryManager & memory) { return memory.make<obj::Childless>(); });
     const auto type = latestObject->type = mTypeCreator.getType({"Stdin"});
     registerBuiltinFunction<NextStdin>({"next", {}, {type}});
 
@@ -496,9 +728,66 @@ bool Compiler::lookupOrCreate(const std::string &key)
 }
 
 
+std::shared_ptr<CompileTimeObject> Compiler::literal(Type type, Object value)
+{
+    int64_t bits;
+    static_assert(sizeof(bits) == sizeof(value));
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    auto & object = mLiterals[{type, bits}];
+    if( ! object ) {
+        object = mObjectProvider.createObject(type);
+        mConstants->add(object->id, value);
+    }
+
+    return object;
+}
+
+
 InstructionPointer Compiler::latestInstructionPointer() const
 {
     return mInstructions.size() - 1;
 }
 
+void Compiler::setPosition(const Position &position)
+{
+    const auto ip = mInstructions.size();
+    if( ! mPositions.empty() ) {
+        auto & latest = mPositions.back();
+        if( latest.line == position.lineNumber && latest.column == position.column ) return;
+        if( latest.ip == ip ) {
+            latest = {ip, position.lineNumber, position.column};
+
+            return;
+        }
+    }
+
+    mPositions.push_back({ip, position.lineNumber, position.column});
+}
+
+InstructionPointer Compiler::appendJumpIfNotPlaceholder(const CompileTimeObject & condition, InstructionPointer ipStartOfCondition)
+{
+    // If the condition was computed by a single instruction, it becomes the placeholder
+    // and is later replaced by a superinstruction, see setJumpIfNot
+    const auto ipLatest = latestInstructionPointer();
+    if( ipLatest >= ipStartOfCondition && mInstructions[ipLatest]->fuseJumpIfNot(condition.id, 0) ) {
+
+        return ipLatest;
+    }
+
+    appendInstruction<ins::Noop>();
+
+    return latestInstructionPointer();
+}
+
+void Compiler::setJumpIfNot(InstructionPointer placeholder, const CompileTimeObject &condition, InstructionPointer ipNew)
+{
+    auto & instruction = mInstructions.at(placeholder);
+    if( auto fused = instruction->fuseJumpIfNot(condition.id, ipNew) ) {
+        instruction = fused;
+    } else {
+        instruction = std::make_shared<ins::JumpIfNot>(condition.id, ipNew);
+    }
+}
+
 } // namespace ct
@@ -2,9 +2,11 @@
 
 #include "lookup.hpp"
 #include "objectprovider.hpp"
+#include "runtime/constantpool.hpp"
 #include "runtime/instructions.hpp"
 #include "parser/visitor.hpp"
 
+#include <map>
 #include <memory>
 #include <unordered_map>
 
@@ -17,9 +19,23 @@ class Compiler: public ast::Visitor
 
 public:
 
-    Compiler();
+    /// When garbage is collected in compiled programs
+    enum class GarbageCollection
+    {
+        /// Only where the program says free
+        Explicit,
+        /// Also at safepoints on loop back-edges and function returns, once the heap has grown enough.
+        /// See ins::Safepoint and MemoryManager::setGrowthThreshold
+        Automatic,
+    };
+
+    explicit Compiler(GarbageCollection collection = GarbageCollection::Explicit);
 
     const InstructionVector & instructions() const;
+    /// Main program, calling the user functions
+    FunctionCode mainFunction() const;
+    bc::Program program() const;
+    const ConstantPool & constants() const { return *mConstants; }
     int numObjectIdsUsed() const { return mObjectProvider.numObjectsIssued(); }
 
     void visitAddition(const ast::Addition &addition) override;
@@ -29,6 +45,9 @@ public:
     void visitComparison(const ast::Comparison &visitable) override;
     void visitFloatLiteral(const ast::FloatLiteral & literal) override;
     void visitFor(const ast::For & loop) override;
+
+    /// For loop over a range, lowered to a counting loop which neither calls next nor allocates
+    void visitCountingFor(const ast::For & loop, const ast::Range & range);
     void visitFree() override;
     void visitFunctionCall(const ast::FunctionCall &functionCall) override;
     void visitFunctionDefinition(const ast::FunctionDefinition &functionCall) override;
@@ -37,6 +56,7 @@ public:
     void visitIntLiteral(const ast::IntLiteral & literal) override;
     void visitName(const ast::Name &name) override;
     void visitOr(const ast::Or & test) override;
+    void visitRange(const ast::Range & range) override;
     void visitScope(const ast::Scope &scope) override;
     void visitStringLiteral(const ast::StringLiteral & visitable) override;
     void visitType(const ast::Type & visitable) override;
@@ -56,12 +76,29 @@ private:
 
     void lookupObject(const ast::Name & name);
 
+    /// Append a safepoint whose roots are filled in by finishSafepoints
+    void appendSafepoint(bool always = false);
+
+    /// Complete the safepoints of the current function with its allocated objects
+    void finishSafepoints(InstructionVector & instructions) const;
+
     void lookupType(const ast::Type &typeTree);
     const Function * lookupFunction(const std::string & functionName, const std::vector<Type> &typeParameters, const std::vector<Type> & argumentTypes, const Position & position);
 
     bool lookupOrCreate(const std::string & key);
+
+    /// Object holding the value of a literal. Every value gets only one object, see ConstantPool
+    std::shared_ptr<CompileTimeObject> literal(Type type, Object value);
     InstructionPointer latestInstructionPointer() const;
 
+    /// Instructions appended from now on stem from position, see FunctionCode::positions
+    void setPosition(const Position & position);
+
+    /// Reserve an instruction for jumping if condition is false.
+    /// Instructions from ipStartOfCondition on must compute the condition
+    InstructionPointer appendJumpIfNotPlaceholder(const CompileTimeObject & condition, InstructionPointer ipStartOfCondition);
+    void setJumpIfNot(InstructionPointer placeholder, const CompileTimeObject & condition, InstructionPointer ipNew);
+
     template<typename T, typename ... Args>
     void appendInstruction(Args && ... args)
     {
@@ -69,7 +106,16 @@ private:
     }
 
     InstructionVector mInstructions;
+    std::vector<SourcePosition> mPositions;
     ObjectProvider mObjectProvider;
+    std::shared_ptr<ConstantPool> mConstants = std::make_shared<ConstantPool>();
+    std::map<std::pair<Type, int64_t>, std::shared_ptr<CompileTimeObject> > mLiterals;
+    std::unordered_map<std::string, std::shared_ptr<CompileTimeObject> > mStringLiterals;
+    const GarbageCollection mGarbageCollection;
+    /// Set by visitFree and safepoints, s.t. function bodies only add a barrier for garbage collection when needed
+    bool mCollectsGarbage = false;
+    /// Instruction pointers of the safepoints of the current function
+    std::vector<InstructionPointer> mSafepoints;
     std::shared_ptr<CompileTimeObject> latestObject = nullptr;
     Type latestType = BasicType::NONE;
     Lookup mLookup;
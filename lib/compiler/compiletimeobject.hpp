@@ -8,6 +8,8 @@ namespace ct {
 struct CompileTimeObject
 {
     ObjectId id;
+    /// Nesting depth of the function owning the object, 0 for the main program
+    size_t depth = 0;
     Type type = BasicType::NONE;
     Type returnType = BasicType::NONE; // Only for functions
 
@@ -1,5 +1,6 @@
 #include "builtins.hpp"
 #include "runtime/instructions.hpp"
+#include "runtime/memorymanager.hpp"
 #include "runtime/objects/list.hpp"
 
 
@@ -17,6 +18,18 @@ void PrintInt::_generateInstructions(
 }
 
 
+void AddInt::_generateInstructions(
+    const std::vector<Type> & ,
+    const std::vector<std::shared_ptr<const CompileTimeObject> > & arguments,
+    InstructionVector & instructions,
+    std::shared_ptr<CompileTimeObject> returnValue
+) const
+{
+    instructions.push_back(std::make_unique<ins::AddInt>(arguments.at(0)->id, arguments.at(1)->id, returnValue->id));
+    returnValue->type = BasicType::INT;
+}
+
+
 void PrintString::_generateInstructions(
     const std::vector<Type> &,
     const std::vector<std::shared_ptr<const CompileTimeObject> > & arguments,
@@ -32,11 +45,13 @@ void ListCtor::_generateInstructions(const std::vector<Type> &typeParameters, co
     const
 {
     returnValue->type = typeCreator().getType({ "List", typeParameters });
-    const auto isAllocated = returnValue->isAllocated();
+
+    // Items of allocated types are pointers which garbage collection has to follow
+    const auto isAllocated = typeParameters.at(0) >= BasicType::STRING;
     instructions.push_back(
         std::make_unique<ins::SetAllocated>(
             returnValue->id,
-            [isAllocated]() { return obj::makeList(isAllocated); }
+            [isAllocated](MemoryManager & memory) { return memory.make<obj::List>(isAllocated); }
         )
                 );
 }
@@ -78,7 +93,11 @@ bool ListAppend::matches(const FunctionKey &key) const
 
 void ListAppend::_generateInstructions(const std::vector<Type> &, const std::vector<std::shared_ptr<const CompileTimeObject> > &arguments, InstructionVector & instructions, std::shared_ptr<CompileTimeObject>) const
 {
-    instructions.push_back(std::make_unique<ins::AppendToList>(arguments.at(0)->id, arguments.at(1)->id));
+    const auto & item = *arguments.at(1);
+    instructions.push_back(std::make_unique<ins::AppendToList>(arguments.at(0)->id, item.id));
+    if( item.isAllocated() ) {
+        instructions.push_back(std::make_unique<ins::WriteBarrier>(arguments.at(0)->id));
+    }
 }
 
 
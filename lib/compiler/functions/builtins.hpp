@@ -15,6 +15,16 @@ private:
 };
 
 
+/// Integer addition as a function, see Compiler::visitAddition
+class AddInt: public PlainFunction
+{
+public:
+    AddInt(const FunctionKey & key): PlainFunction(key) {}
+private:
+    void _generateInstructions(const std::vector<Type> &typeParameters, const std::vector<std::shared_ptr<const CompileTimeObject> > &arguments, InstructionVector &instructions, std::shared_ptr<CompileTimeObject> returnValue) const;
+};
+
+
 // TODO: templated print function
 class PrintString: public PlainFunction
 {
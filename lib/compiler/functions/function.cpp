@@ -10,6 +10,26 @@ void Function::generateInstructions(const std::vector<Type> &typeParameters,
     InstructionVector & instructions,
     std::shared_ptr<CompileTimeObject> output
 ) const
+{
+    checkParameters(typeParameters, arguments);
+    _generateInstructions(typeParameters, arguments, instructions, output);
+}
+
+bool Function::generateUnboxedOptional(const std::vector<Type> &typeParameters,
+    const std::vector<std::shared_ptr<const CompileTimeObject> > &arguments,
+    InstructionVector &instructions,
+    std::shared_ptr<CompileTimeObject> tag,
+    std::shared_ptr<CompileTimeObject> value
+) const
+{
+    checkParameters(typeParameters, arguments);
+
+    return _generateUnboxedOptional(typeParameters, arguments, instructions, tag, value);
+}
+
+void Function::checkParameters(const std::vector<Type> &typeParameters,
+    const std::vector<std::shared_ptr<const CompileTimeObject> > &arguments
+) const
 {
     std::vector<Type> argumentTypes;
     for(const auto & argument : arguments) argumentTypes.push_back(argument->type);
@@ -18,8 +38,6 @@ void Function::generateInstructions(const std::vector<Type> &typeParameters,
 
         throw CompilerBug {"Given parameters do not match function requirements"};
     }
-
-    _generateInstructions(typeParameters, arguments, instructions, output);
 }
 
 } // namespace ct
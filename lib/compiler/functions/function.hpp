@@ -22,6 +22,17 @@ public:
         std::shared_ptr<CompileTimeObject> returnValue
     ) const;
 
+    /// Instead of an Optional, write its tag to tag and its value to value, s.t. loops over the function do not
+    /// allocate an Optional per iteration, see Compiler::visitFor. Sets the type of value.
+    /// False without generating anything if the function only returns complete Optionals
+    bool generateUnboxedOptional(
+        const std::vector<Type> & typeParameters,
+        const std::vector<std::shared_ptr<const CompileTimeObject> > & arguments,
+        InstructionVector & instructions,
+        std::shared_ptr<CompileTimeObject> tag,
+        std::shared_ptr<CompileTimeObject> value
+    ) const;
+
     virtual const std::string & name() const = 0;
     virtual size_t numTypeParameters() const = 0;
     virtual size_t numArguments() const = 0;
@@ -37,6 +48,20 @@ private:
         InstructionVector & instructions,
         std::shared_ptr<CompileTimeObject> returnValue
     ) const = 0;
+
+    virtual bool _generateUnboxedOptional(
+        const std::vector<Type> & /* typeParameters */,
+        const std::vector<std::shared_ptr<const CompileTimeObject> > & /* arguments */,
+        InstructionVector & /* instructions */,
+        std::shared_ptr<CompileTimeObject> /* tag */,
+        std::shared_ptr<CompileTimeObject> /* value */
+    ) const { return false; }
+
+    /// Throw if the function does not accept the given parameters
+    void checkParameters(
+        const std::vector<Type> & typeParameters,
+        const std::vector<std::shared_ptr<const CompileTimeObject> > & arguments
+    ) const;
 };
 
 
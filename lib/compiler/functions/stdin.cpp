@@ -1,5 +1,6 @@
 #include "stdin.hpp"
 #include "runtime/instructions.hpp"
+#include "runtime/memorymanager.hpp"
 
 
 namespace ct {
@@ -14,10 +15,11 @@ void NextStdin::_generateInstructions(const std::vector<Type> &,
     // Prepare output variable
     const TypeKey typeKey {"Optional", {BasicType::NONE, BasicType::STRING}};
     returnValue->type = typeCreator().getType(typeKey);
+    const auto tupleType = registerTupleType(typeKey);
     instructions.push_back(
         std::make_shared<ins::SetAllocated>(
-            returnValue->id, []{
-                return std::make_unique<obj::Tuple<2> >(); }
+            returnValue->id, [tupleType](MemoryManager & memory) {
+                return memory.make<obj::Tuple<2> >(tupleType); }
         )
     );
 
@@ -25,5 +27,18 @@ void NextStdin::_generateInstructions(const std::vector<Type> &,
     instructions.push_back(std::make_unique<ins::ReadFromStdin>(returnValue->id));
 }
 
+bool NextStdin::_generateUnboxedOptional(const std::vector<Type> &,
+    const std::vector<std::shared_ptr<const CompileTimeObject> > &,
+    InstructionVector & instructions,
+    std::shared_ptr<CompileTimeObject> tag,
+    std::shared_ptr<CompileTimeObject> value
+) const
+{
+    value->type = BasicType::STRING;
+    instructions.push_back(std::make_unique<ins::ReadLine>(tag->id, value->id));
+
+    return true;
+}
+
 
 } // namespace obj
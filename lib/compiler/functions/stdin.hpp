@@ -18,6 +18,14 @@ private:
         InstructionVector & instructions,
         std::shared_ptr<CompileTimeObject> returnValue
     ) const override;
+
+    bool _generateUnboxedOptional(
+        const std::vector<Type> & typeParameters,
+        const std::vector<std::shared_ptr<const CompileTimeObject> > & arguments,
+        InstructionVector & instructions,
+        std::shared_ptr<CompileTimeObject> tag,
+        std::shared_ptr<CompileTimeObject> value
+    ) const override;
 };
 
 } // namespace ct
@@ -4,13 +4,11 @@
 
 namespace ct {
 
-UserFunction::UserFunction(const FunctionKey &key, std::vector<std::shared_ptr<CompileTimeObject> > argumentSlots, std::shared_ptr<const CompileTimeObject> returnObject, InstructionVector instructions)
+UserFunction::UserFunction(const FunctionKey &key, std::shared_ptr<const FunctionCode> code, Type returnType)
     : PlainFunction(key)
-    , mArgumentSlots(std::move(argumentSlots))
-    , mReturnObject(returnObject)
-    , mInstructions(std::move(instructions))
+    , mCode(std::move(code))
+    , mReturnType(returnType)
 {
-    for(const auto & slot : mArgumentSlots) mArgumentTypes.push_back(slot->type);
 }
 
 void UserFunction::_generateInstructions(const std::vector<Type> &,
@@ -21,19 +19,11 @@ void UserFunction::_generateInstructions(const std::vector<Type> &,
 {
     // NOTE: Parent class already checks if vectors have same length
 
-    // Copy arguments to argument slots
-    for(size_t i = 0; i < arguments.size(); i++) {
-        auto arg = arguments.at(i);
-        auto slot = mArgumentSlots.at(i);
-        instructions.emplace_back(std::make_shared<ins::Copy>(arg->id, slot->id));
-    }
+    std::vector<ObjectId> argumentIds;
+    for(const auto & argument : arguments) argumentIds.push_back(argument->id);
 
-    for(const auto & instruction : mInstructions) {
-        instructions.emplace_back(instruction);
-    }
-
-    // Target object is same as latest object
-    *returnValue = *mReturnObject;
+    instructions.emplace_back(std::make_shared<ins::Call>(mCode, std::move(argumentIds), returnValue->id));
+    returnValue->type = mReturnType;
 }
 
 } // namespace ct
@@ -2,7 +2,7 @@
 #include "function.hpp"
 
 
-class Instruction;
+struct FunctionCode;
 
 
 namespace ct {
@@ -11,9 +11,7 @@ class UserFunction: public PlainFunction // TODO: allow template user  functions
 {
 public:
 
-    UserFunction(
-        const FunctionKey & key,
-        std::vector<std::shared_ptr<CompileTimeObject> > argumentSlots, std::shared_ptr<const CompileTimeObject> returnObject, InstructionVector instructions);
+    UserFunction(const FunctionKey & key, std::shared_ptr<const FunctionCode> code, Type returnType);
 
 private:
 
@@ -24,10 +22,8 @@ private:
         std::shared_ptr<CompileTimeObject> returnValue
     ) const override;
 
-    std::vector<std::shared_ptr<CompileTimeObject> > mArgumentSlots;
-    std::vector<Type> mArgumentTypes;
-    std::shared_ptr<const CompileTimeObject> mReturnObject;
-    InstructionVector mInstructions;
+    std::shared_ptr<const FunctionCode> mCode;
+    Type mReturnType;
 
 };
 
@@ -5,10 +5,22 @@ namespace ct {
 std::shared_ptr<CompileTimeObject> ObjectProvider::createObject(Type type)
 {
     auto object = std::make_shared<CompileTimeObject>();
-    object->id = mNextObjectId++;
+    object->id = mObjects.size();
+    object->depth = mDepth;
     object->type = type;
+    mObjects.push_back(object);
 
     return object;
 }
 
+std::vector<ObjectId> ObjectProvider::allocatedObjects() const
+{
+    std::vector<ObjectId> ret;
+    for(const auto & object : mObjects) {
+        if( object->isAllocated() ) ret.push_back(object->id);
+    }
+
+    return ret;
+}
+
 } // namespace ct
@@ -1,19 +1,29 @@
 #pragma once
 #include "compiletimeobject.hpp"
 #include <memory>
+#include <vector>
 
 
 namespace ct {
 
+/// Issues the objects of one function, see FunctionCode
 class ObjectProvider
 {
 public:
+    ObjectProvider(size_t depth = 0): mDepth(depth) {}
+
     std::shared_ptr<CompileTimeObject> createObject(Type type = BasicType::NONE);
 
-    size_t numObjectsIssued() const { return mNextObjectId; }
+    size_t numObjectsIssued() const { return mObjects.size(); }
+
+    /// Ids of all issued objects whose type is allocated by now
+    std::vector<ObjectId> allocatedObjects() const;
+
+    size_t depth() const { return mDepth; }
 
 private:
-    size_t mNextObjectId = 0;
+    std::vector<std::shared_ptr<const CompileTimeObject> > mObjects;
+    size_t mDepth;
 };
 
 } // namespace ct
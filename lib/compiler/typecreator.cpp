@@ -1,5 +1,6 @@
 #include "typecreator.hpp"
 #include "common/exceptions.hpp"
+#include "runtime/objects/tuple.hpp"
 
 
 bool TypeKey::operator==(const TypeKey &other) const
@@ -69,6 +70,21 @@ Type getOptionalType(const TypeCreator &typeCreator, Type type)
     return typeKey.typeParameters[1];
 }
 
+obj::TypeIndex registerTupleType(const TypeKey &key)
+{
+    if( key.typeParameters.size() != 2 ) {
+
+        throw MissingFeature { "Only pairs can be allocated so far" };
+    }
+
+    std::bitset<2> isPointer;
+    for(size_t i = 0; i < 2; i++) {
+        isPointer[i] = key.typeParameters[i] >= BasicType::STRING;
+    }
+
+    return obj::registerType(obj::Tuple<2>::describe(key.toString(), isPointer));
+}
+
 TypeCreator & typeCreator()
 {
     static TypeCreator ret;
@@ -1,6 +1,8 @@
 #pragma once
 #include "common/utils.hpp"
+#include "runtime/objects/allocated.hpp"
 
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -79,3 +81,6 @@ TypeCreator &typeCreator();
 // TODO: move somewhere else
 Type getOptionalType(const TypeCreator & typeCreator, Type type);
 
+/// Runtime layout of a tuple of the type parameters of key. Elements of allocated types are pointers
+obj::TypeIndex registerTupleType(const TypeKey & key);
+
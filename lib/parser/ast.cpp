@@ -138,6 +138,20 @@ void Addition::acceptVisitor(Visitor &visitor) const
     visitor.visitAddition(*this);
 }
 
+Range::Range(std::unique_ptr<Expression> &&start, std::unique_ptr<Expression> &&end, std::unique_ptr<Expression> &&step)
+    : Expression(start->position())
+    , mStart(std::move(start))
+    , mEnd(std::move(end))
+    , mStep(std::move(step))
+{
+
+}
+
+void Range::acceptVisitor(Visitor &visitor) const
+{
+    visitor.visitRange(*this);
+}
+
 While::While(std::unique_ptr<Expression> &&condition, std::unique_ptr<Scope> &&body, const Position &position)
     : Statement(position)
     , mCondition(std::move(condition))
@@ -208,6 +208,21 @@ public:
 };
 
 
+/// Integers from start up to, but not including, end. Only counts up
+class Range: public Expression
+{
+public:
+    /// step may be nullptr for steps of one
+    Range(std::unique_ptr<Expression> && start, std::unique_ptr<Expression> && end, std::unique_ptr<Expression> && step);
+
+    void acceptVisitor(Visitor & visitor) const override;
+
+    std::unique_ptr<Expression> mStart;
+    std::unique_ptr<Expression> mEnd;
+    std::unique_ptr<Expression> mStep;
+};
+
+
 class Assignment: public Statement
 {
 public:
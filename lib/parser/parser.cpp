@@ -148,7 +148,29 @@ std::unique_ptr<ast::Assignee> parseAssignee(TokenIterator &it, const TokenItera
 
 std::unique_ptr<ast::Expression> parseExpression(TokenIterator &it, const TokenIterator &end, int indent)
 {
-    return parseOr(it, end, indent);
+    return parseRange(it, end, indent);
+}
+
+std::unique_ptr<ast::Expression> parseRange(TokenIterator &it, const TokenIterator &end, int indent)
+{
+    auto start = parseOr(it, end, indent);
+    if( it == end || it->type != Token::Range ) {
+
+        return start;
+    }
+
+    it++; // Consume operator
+
+    auto stop = parseOr(it, end, indent);
+
+    // 'by' is no keyword, s.t. it can still be used as a name
+    std::unique_ptr<ast::Expression> step;
+    if( it != end && it->type == Token::Name && it->value == "by" ) {
+        it++; // Consume "by"
+        step = parseOr(it, end, indent);
+    }
+
+    return std::make_unique<ast::Range>(std::move(start), std::move(stop), std::move(step));
 }
 
 std::unique_ptr<ast::Expression> parseOr(TokenIterator &it, const TokenIterator &end, int indent)
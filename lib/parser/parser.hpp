@@ -18,6 +18,7 @@ std::unique_ptr<ast::Assignee> parseAssignee(TokenIterator & it, const TokenIter
 
 std::unique_ptr<ast::Expression> parseExpression(TokenIterator & it, const TokenIterator & end, int indent);
 
+std::unique_ptr<ast::Expression> parseRange(TokenIterator & it, const TokenIterator & end, int indent);
 std::unique_ptr<ast::Expression> parseOr(TokenIterator & it, const TokenIterator & end, int indent);
 
 std::unique_ptr<ast::Expression> parseAnd(TokenIterator & it, const TokenIterator & end, int indent);
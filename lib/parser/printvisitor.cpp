@@ -151,6 +151,17 @@ void PrintVisitor::visitOr(const Or &visitable)
     visitable.mRight->acceptVisitor(*this);
 }
 
+void PrintVisitor::visitRange(const Range &range)
+{
+    range.mStart->acceptVisitor(*this);
+    mOut << "..";
+    range.mEnd->acceptVisitor(*this);
+    if( range.mStep ) {
+        mOut << " by ";
+        range.mStep->acceptVisitor(*this);
+    }
+}
+
 void PrintVisitor::visitScope(const Scope &scope)
 {
     for(const auto & statement : scope.mStatements) {
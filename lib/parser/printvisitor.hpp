@@ -25,6 +25,7 @@ public:
     void visitIntLiteral(const IntLiteral &literal) override;
     void visitName(const Name &name) override;
     void visitOr(const Or & visitable) override;
+    void visitRange(const Range & range) override;
     void visitScope(const Scope &scope) override;
     void visitStringLiteral(const StringLiteral & visitable) override;
     void visitTypeName(const TypeName & visitable) override;
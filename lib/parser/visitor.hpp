@@ -17,6 +17,7 @@ class IfThenElse;
 class IntLiteral;
 class Name;
 class Or;
+class Range;
 class Scope;
 class StringLiteral;
 class Type;
@@ -44,6 +45,7 @@ public:
     virtual void visitIntLiteral(const IntLiteral & intLiteral) = 0;
     virtual void visitName(const Name & name) = 0;
     virtual void visitOr(const Or & test) = 0;
+    virtual void visitRange(const Range & range) = 0;
     virtual void visitScope(const Scope & scope) = 0;
     virtual void visitStringLiteral(const StringLiteral & visitable) = 0;
     virtual void visitType(const Type & visitable) = 0;
@@ -0,0 +1,82 @@
+#include "arena.hpp"
+
+#include <new>
+
+
+static_assert(Arena::granularity >= alignof(std::max_align_t), "Slots must be suitably aligned for any object");
+static_assert(Arena::sizeClass(1) == 0 && Arena::sizeClass(16) == 0 && Arena::sizeClass(17) == 1, "Unexpected size classes");
+
+
+void * Arena::allocate(size_t size)
+{
+    const auto index = sizeClass(size);
+    if( index == large ) return ::operator new(size);
+
+    auto & pages = mPages[index];
+    if( pages.freeList ) {
+        const auto ret = pages.freeList;
+        pages.freeList = ret->next;
+
+        return ret;
+    }
+
+    const auto slotSize = ( index + 1 ) * granularity;
+    if( pages.next + slotSize > pages.end ) return allocateSlow(pages, slotSize);
+
+    const auto ret = pages.next;
+    pages.next += slotSize;
+
+    return ret;
+}
+
+void * Arena::allocateSlow(Pages &pages, size_t slotSize)
+{
+    // Continue with the next page, which may be left over from before clear()
+    if( pages.next ) pages.current++;
+    if( pages.current == pages.pages.size() ) {
+        pages.pages.emplace_back(new char[pageSize]);
+        mNumPages++;
+    }
+
+    const auto page = pages.pages[pages.current].get();
+    pages.next = page + slotSize;
+    pages.end = page + pageSize;
+
+    return page;
+}
+
+void Arena::deallocate(void *ptr, uint8_t sizeClass)
+{
+    if( sizeClass == large ) {
+        ::operator delete(ptr);
+
+        return;
+    }
+
+    auto & pages = mPages[sizeClass];
+    pages.freeList = new (ptr) FreeSlot {pages.freeList};
+}
+
+void Arena::clear()
+{
+    for(auto & pages : mPages) {
+        pages.current = 0;
+        pages.next = nullptr;
+        pages.end = nullptr;
+        pages.freeList = nullptr;
+    }
+}
+
+void Arena::beginCompaction()
+{
+    for(auto & pages : mPages) {
+        for(auto & page : pages.pages) mCompacted.push_back(std::move(page));
+        pages = Pages {};
+    }
+}
+
+void Arena::finishCompaction()
+{
+    mNumPages -= mCompacted.size();
+    mCompacted.clear();
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+/// Memory for the objects of a MemoryManager.
+///
+/// Sizes are rounded up to a size class. Every class cuts slots from pages by bumping a pointer,
+/// freed slots go to a free list of their class and are reused before the pointer moves on.
+/// Objects too large for any class are allocated individually.
+class Arena
+{
+public:
+
+    /// Step between size classes, also the alignment of every slot
+    static constexpr size_t granularity = 16;
+    static constexpr size_t numSizeClasses = 16;
+    static constexpr size_t pageSize = 64 * 1024;
+
+    /// Size class of objects which are allocated individually
+    static constexpr uint8_t large = numSizeClasses;
+
+    static constexpr uint8_t sizeClass(size_t size)
+    {
+        return size <= granularity * numSizeClasses ? ( size + granularity - 1 ) / granularity - ( size > 0 ) : large;
+    }
+
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena & operator=(const Arena &) = delete;
+
+    void * allocate(size_t size);
+
+    /// Return memory of allocate(size) with sizeClass(size)
+    void deallocate(void * ptr, uint8_t sizeClass);
+
+    /// Free all slots at once. Pages are kept for reuse, large objects must have been deallocated
+    void clear();
+
+    /// Cut slots from new pages from now on, s.t. objects moved there end up next to each other.
+    /// The pages so far stay valid until finishCompaction
+    void beginCompaction();
+
+    /// Free the pages from before beginCompaction. None of their slots may be used anymore
+    void finishCompaction();
+
+    /// Bytes held in pages
+    size_t reserved() const { return mNumPages * pageSize; }
+
+private:
+
+    struct FreeSlot
+    {
+        FreeSlot * next;
+    };
+
+    struct Pages
+    {
+        std::vector<std::unique_ptr<char[]> > pages;
+        /// Index of the page which is being cut into slots
+        size_t current = 0;
+        char * next = nullptr;
+        char * end = nullptr;
+        FreeSlot * freeList = nullptr;
+    };
+
+    void * allocateSlow(Pages & pages, size_t slotSize);
+
+    Pages mPages[numSizeClasses];
+    size_t mNumPages = 0;
+
+    /// Pages from before beginCompaction
+    std::vector<std::unique_ptr<char[]> > mCompacted;
+};
@@ -0,0 +1,470 @@
+#include "bytecode.hpp"
+#include "common/exceptions.hpp"
+#include "runtime/instructions.hpp"
+#include "runtime/slotallocation.hpp"
+
+#include <algorithm>
+#include <limits>
+
+
+namespace bc {
+
+namespace {
+
+    using O = Operand;
+
+    const std::vector<OpcodeInfo> opcodeInfos = {
+        {"Halt", {}},
+
+        {"SetInt", {O::Write, O::Constant}},
+        {"SetFloat", {O::Write, O::Constant}},
+        {"SetBoolean", {O::Write, O::Immediate}},
+        {"SetAllocated", {O::Write, O::Creator}},
+
+        {"AddInt", {O::Read, O::Read, O::Write}},
+        {"AddIntImmediate", {O::Read, O::Constant, O::Write}},
+
+        {"IntLessThan", {O::Read, O::Read, O::Write}},
+        {"IntLTE", {O::Read, O::Read, O::Write}},
+        {"IsEqual", {O::Read, O::Read, O::Write}},
+        {"IsNotEqual", {O::Read, O::Read, O::Write}},
+        {"IntGTE", {O::Read, O::Read, O::Write}},
+        {"IntGreaterThan", {O::Read, O::Read, O::Write}},
+
+        {"OrTest", {O::Read, O::Read, O::Write}},
+        {"AndTest", {O::Read, O::Read, O::Write}},
+        {"Negate", {O::Read, O::Write}},
+
+        {"Copy", {O::Read, O::Write}},
+        {"Jump", {O::Target}},
+        {"JumpIf", {O::Read, O::Target}},
+        {"JumpIfNot", {O::Read, O::Target}},
+        {"JumpIfNotIntLessThan", {O::Read, O::Read, O::Target}},
+        {"JumpIfNotIntLTE", {O::Read, O::Read, O::Target}},
+        {"JumpIfNotIsEqual", {O::Read, O::Read, O::Target}},
+        {"JumpIfNotIsNotEqual", {O::Read, O::Read, O::Target}},
+        {"AddIntJumpIfLessThan", {O::Read, O::Read, O::Read, O::Write, O::Target}},
+        {"CheckStep", {O::Read, O::Immediate, O::Immediate}},
+
+        {"CollectGarbage", {O::ReadList, O::GlobalList}},
+        {"Safepoint", {O::Roots, O::Immediate}},
+        {"ReadFromTuple", {O::Read, O::Immediate, O::Write}},
+        {"WriteToTuple", {O::Read, O::Immediate, O::Read}},
+
+        {"PrintInt", {O::Read}},
+        {"PrintString", {O::Read}},
+        {"ReadFromStdin", {O::Read}},
+        {"ReadLine", {O::Write, O::Write}},
+
+        {"MemPush", {}},
+        {"MemPop", {}},
+        {"PopRegion", {O::ReadList}},
+
+        {"GetListLength", {O::Read, O::Write}},
+        {"AppendToList", {O::Read, O::Read}},
+        {"WriteBarrier", {O::Read}},
+
+        {"LoadGlobal", {O::Global, O::Write}},
+        {"StoreGlobal", {O::Read, O::Global}},
+        {"Call", {O::Function, O::Write, O::ReadList}},
+        {"Return", {O::Read}},
+    };
+
+    /// Functions whose body takes at most this many words are inlined, see Assembler::emitCall
+    constexpr size_t maxInlineLength = 32;
+
+    bool isList(Operand operand)
+    {
+        return operand == Operand::ReadList || operand == Operand::GlobalList;
+    }
+
+}
+
+
+const OpcodeInfo &info(Opcode opcode)
+{
+    if( opcodeInfos.size() != NumOpcodes ) {
+
+        throw CompilerBug { "Opcode table does not match opcodes" };
+    }
+
+    return opcodeInfos.at(opcode);
+}
+
+size_t length(const Word *pc)
+{
+    size_t ret = 1;
+    for(auto operand : info(static_cast<Opcode>(*pc)).operands) {
+        if( isList(operand) ) {
+            ret += 1 + pc[ret];
+        } else {
+            ret += 1;
+        }
+    }
+
+    return ret;
+}
+
+
+size_t Program::end(size_t function) const
+{
+    return function + 1 < functions.size() ? functions[function + 1].entry : code.size();
+}
+
+const Origin *Program::origin(size_t offset) const
+{
+    // Noops occupy no code, the last origin at an offset is the instruction found there
+    auto found = std::upper_bound(origins.begin(), origins.end(), offset, [](size_t offset, const Origin & origin) {
+        return offset < origin.offset;
+    });
+    if( found == origins.begin() ) return nullptr;
+    found--;
+
+    return found->instruction ? &*found : nullptr;
+}
+
+const Location &Program::location(size_t offset) const
+{
+    auto found = std::upper_bound(locations.begin(), locations.end(), offset, [](size_t offset, const Location & location) {
+        return offset < location.offset;
+    });
+    if( found == locations.begin() ) {
+
+        throw CompilerBug { "No location for offset " + std::to_string(offset) };
+    }
+
+    return *(found - 1);
+}
+
+size_t Program::function(size_t offset) const
+{
+    auto found = std::upper_bound(functions.begin(), functions.end(), offset, [](size_t offset, const Function & function) {
+        return offset < function.entry;
+    });
+    if( found == functions.begin() ) {
+
+        throw CompilerBug { "No function at offset " + std::to_string(offset) };
+    }
+
+    return found - functions.begin() - 1;
+}
+
+
+Assembler::Assembler(const FunctionCode &main)
+{
+    addFunction(main);
+}
+
+void Assembler::emit(Opcode opcode, const std::vector<size_t> &operands)
+{
+    for(auto operand : operands) {
+        if( operand > std::numeric_limits<Word>::max() ) {
+
+            throw MissingFeature { "Operand does not fit into bytecode word" };
+        }
+    }
+
+    const auto & operandTypes = info(opcode).operands;
+
+    mProgram.code.push_back(opcode);
+
+    size_t i = 0;
+    for(auto operandType : operandTypes) {
+        if( i >= operands.size() ) {
+
+            throw CompilerBug { std::string {"Too few operands for "} + info(opcode).name };
+        }
+
+        if( operandType == Operand::Target ) {
+            mJumps.push_back(mProgram.code.size());
+        }
+
+        if( isList(operandType) ) {
+            const auto n = operands[i];
+            if( i + n + 1 > operands.size() ) {
+
+                throw CompilerBug { std::string {"Too few operands for "} + info(opcode).name };
+            }
+            for(size_t j = 0; j <= n; j++) {
+                mProgram.code.push_back(operands[i + j]);
+            }
+            i += n + 1;
+        } else {
+            mProgram.code.push_back(operands[i]);
+            i++;
+        }
+    }
+
+    if( i != operands.size() ) {
+
+        throw CompilerBug { std::string {"Too many operands for "} + info(opcode).name };
+    }
+}
+
+void Assembler::emitCall(const std::shared_ptr<const FunctionCode> & function, const std::vector<ObjectId> & arguments, ObjectId target)
+{
+    if( arguments.size() != function->numArguments ) {
+
+        throw CompilerBug { "Wrong number of arguments for " + function->name };
+    }
+
+    if( ! mInlining && inlineCall(*function, arguments, target) ) return;
+
+    // While inlining, the call only serves to reject the body, see inlineCall
+    const auto index = mInlining ? 0 : addFunction(*function);
+    std::vector<size_t> operands = {index, target, arguments.size()};
+    operands.insert(operands.end(), arguments.begin(), arguments.end());
+    emit(Call, operands);
+}
+
+Word Assembler::addConstant(Object value)
+{
+    mProgram.constants.push_back(value);
+
+    return mProgram.constants.size() - 1;
+}
+
+Word Assembler::addCreator(Creator creator)
+{
+    mProgram.creators.push_back(std::move(creator));
+
+    return mProgram.creators.size() - 1;
+}
+
+Word Assembler::addRoots(Roots roots)
+{
+    mProgram.roots.push_back(std::move(roots));
+
+    return mProgram.roots.size() - 1;
+}
+
+void Assembler::nextInstruction()
+{
+    mOffsets.push_back(mProgram.code.size());
+}
+
+Program Assembler::finish()
+{
+    // Calls append to mFunctionCode while it is being iterated
+    for(mCurrentFunction = 0; mCurrentFunction < mFunctionCode.size(); mCurrentFunction++) {
+        mProgram.functions[mCurrentFunction].entry = mProgram.code.size();
+        mOffsets.clear();
+
+        const auto & instructions = mFunctionCode[mCurrentFunction]->instructions;
+        const auto & positions = mFunctionCode[mCurrentFunction]->positions;
+        auto position = positions.begin();
+        if( position == positions.end() || position->ip > 0 ) {
+            mProgram.locations.push_back({mProgram.code.size(), 0, 0});
+        }
+
+        for(InstructionPointer ip = 0; ip < instructions.size(); ip++) {
+            nextInstruction();
+            for(; position != positions.end() && position->ip <= ip; position++) {
+                mProgram.locations.push_back({mProgram.code.size(), position->line, position->column});
+            }
+            mProgram.origins.push_back({mProgram.code.size(), mCurrentFunction, ip, instructions[ip]});
+            instructions[ip]->encode(*this);
+        }
+
+        if( mCurrentFunction == 0 ) {
+            // Jumping past the last instruction ends the program
+            nextInstruction();
+            mProgram.origins.push_back({mProgram.code.size(), mCurrentFunction, instructions.size(), nullptr});
+            emit(Halt);
+        }
+
+        for(const auto position : mJumps) {
+            auto & target = mProgram.code[position];
+            if( target >= mOffsets.size() ) {
+
+                throw CompilerBug { "Jump target out of range" };
+            }
+            target = mOffsets[target];
+        }
+        mJumps.clear();
+    }
+
+    return std::move(mProgram);
+}
+
+Word Assembler::addFunction(const FunctionCode &function)
+{
+    const auto found = mFunctionIndices.find(&function);
+    if( found != mFunctionIndices.end() ) return found->second;
+
+    Function assembled;
+    assembled.name = function.name;
+    assembled.numObjects = function.numObjects;
+    assembled.numArguments = function.numArguments;
+    for(const auto & [id, value] : function.constants->values()) {
+        assembled.literals.emplace_back(id, value);
+    }
+    mProgram.functions.push_back(std::move(assembled));
+    mProgram.constantPools.push_back(function.constants);
+    mFunctionCode.push_back(&function);
+
+    return mFunctionIndices[&function] = mProgram.functions.size() - 1;
+}
+
+bool Assembler::inlineCall(const FunctionCode &function, const std::vector<ObjectId> &arguments, ObjectId target)
+{
+    auto & code = mProgram.code;
+    const auto start = code.size();
+    const auto numConstants = mProgram.constants.size();
+    const auto numCreators = mProgram.creators.size();
+    const auto numRoots = mProgram.roots.size();
+    const auto numJumps = mJumps.size();
+
+    // Objects of the function are appended to the objects of the caller
+    const auto offset = mProgram.functions[mCurrentFunction].numObjects;
+
+    for(size_t i = 0; i < arguments.size(); i++) {
+        emit(Copy, {arguments[i], offset + i});
+    }
+
+    const auto startOfBody = code.size();
+    mInlining = true;
+    for(const auto & instruction : function.instructions) {
+        instruction->encode(*this);
+    }
+    mInlining = false;
+
+    // Only straight code without calls or garbage collection, ending with a single Return.
+    // Freeing the objects of the function at its end is fine, see PopRegion
+    bool suited = ( code.size() - startOfBody <= maxInlineLength && mJumps.size() == numJumps );
+    size_t pcReturn = code.size();
+    for(size_t pc = startOfBody; suited && pc < code.size(); pc += length(&code[pc])) {
+        switch( code[pc] ) {
+        case Return:
+            pcReturn = pc;
+            suited = ( pc + length(&code[pc]) == code.size() );
+            break;
+        case Halt:
+        case Call:
+        case CollectGarbage:
+        case Safepoint:
+        case MemPop:
+            suited = false;
+            break;
+        }
+    }
+    suited = suited && pcReturn < code.size();
+
+    if( ! suited ) {
+        code.resize(start);
+        mProgram.constants.resize(numConstants);
+        mProgram.creators.resize(numCreators);
+        mProgram.roots.resize(numRoots);
+        mJumps.resize(numJumps);
+
+        return false;
+    }
+
+    for(size_t pc = startOfBody; pc < code.size(); pc += length(&code[pc])) {
+        forEachObject(&code[pc], [offset](Word & id, Operand operand) {
+            if( operand != Operand::Global ) id += offset;
+        });
+    }
+
+    // Return value goes directly to the target
+    const auto returnValue = code[pcReturn + 1];
+    code.resize(pcReturn);
+    emit(Copy, {returnValue, target});
+
+    auto & caller = mProgram.functions[mCurrentFunction];
+    caller.numObjects += function.numObjects;
+    for(const auto & [id, value] : function.constants->values()) {
+        caller.literals.emplace_back(offset + id, value);
+    }
+    mProgram.constantPools.push_back(function.constants);
+
+    return true;
+}
+
+
+Program assemble(const FunctionCode &main)
+{
+    Assembler assembler(main);
+    auto program = assembler.finish();
+    removeUnusedObjects(program);
+    allocateSlots(program);
+
+    // Computed once s.t. executing the program many times does not repeat the work
+    for(auto & function : program.functions) {
+        function.initialFrame.assign(function.numObjects, {});
+        for(const auto & [id, value] : function.literals) {
+            function.initialFrame[id] = value;
+        }
+    }
+
+    return program;
+}
+
+
+void removeUnusedObjects(Program &program)
+{
+    constexpr auto unused = std::numeric_limits<Word>::max();
+
+    struct Renumbering
+    {
+        std::vector<Word> newIds;
+        Word numUsed = 0;
+
+        Word operator()(Word id)
+        {
+            if( newIds.at(id) == unused ) newIds[id] = numUsed++;
+
+            return newIds[id];
+        }
+    };
+
+    std::vector<Renumbering> renumberings;
+    for(const auto & function : program.functions) {
+        Renumbering renumbering { std::vector<Word>(function.numObjects, unused) };
+        while( renumbering.numUsed < function.numArguments ) renumbering(renumbering.numUsed);
+        renumberings.push_back(std::move(renumbering));
+    }
+
+    // Globals are objects of the main program
+    auto & code = program.code;
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        for(size_t pc = program.functions[i].entry; pc < program.end(i); pc += length(&code[pc])) {
+            forEachObject(&code[pc], [&](Word & id, Operand operand) {
+                id = renumberings[operand == Operand::Global ? 0 : i](id);
+            });
+        }
+    }
+
+    // Roots which are not used by any instruction cannot point anywhere
+    const auto keepUsed = [](std::vector<Word> & ids, const std::vector<Word> & newIds) {
+        std::vector<Word> used;
+        for(const auto id : ids) {
+            if( newIds.at(id) != unused ) used.push_back(newIds[id]);
+        }
+        ids = std::move(used);
+    };
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        for(size_t pc = program.functions[i].entry; pc < program.end(i); pc += length(&code[pc])) {
+            if( code[pc] != Safepoint ) continue;
+            auto & roots = program.roots.at(code[pc + 1]);
+            keepUsed(roots.objects, renumberings[i].newIds);
+            keepUsed(roots.globals, renumberings[0].newIds);
+        }
+    }
+
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        auto & function = program.functions[i];
+        const auto & newIds = renumberings[i].newIds;
+
+        std::vector<std::pair<Word, Object> > literals;
+        for(const auto & [id, value] : function.literals) {
+            if( newIds.at(id) != unused ) literals.emplace_back(newIds[id], value);
+        }
+        function.literals = std::move(literals);
+
+        function.numObjects = renumberings[i].numUsed;
+    }
+}
+
+
+} // namespace bc
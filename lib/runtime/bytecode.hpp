@@ -0,0 +1,297 @@
+#pragma once
+#include "common/object.hpp"
+#include "runtime/constantpool.hpp"
+#include "runtime/objects/allocated.hpp"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class Instruction;
+class MemoryManager;
+struct FunctionCode;
+using InstructionVector = std::vector<std::shared_ptr<const Instruction> >;
+using InstructionPointer = size_t;
+
+
+/// Flat bytecode executed by run(const bc::Program &).
+///
+/// Every instruction is an opcode word followed by its operands.
+/// Anything that does not fit into a word (64 bit literals, strings, object creators, roots)
+/// lives in a pool of the program and is referenced by index.
+namespace bc {
+
+
+using Word = uint32_t;
+
+
+enum Opcode: Word {
+    Halt,
+
+    SetInt,
+    SetFloat,
+    SetBoolean,
+    SetAllocated,
+
+    AddInt,
+    AddIntImmediate,
+
+    IntLessThan,
+    IntLTE,
+    IsEqual,
+    IsNotEqual,
+    IntGTE,
+    IntGreaterThan,
+
+    OrTest,
+    AndTest,
+    Negate,
+
+    Copy,
+    Jump,
+    JumpIf,
+    JumpIfNot,
+    JumpIfNotIntLessThan,
+    JumpIfNotIntLTE,
+    JumpIfNotIsEqual,
+    JumpIfNotIsNotEqual,
+    AddIntJumpIfLessThan,
+    CheckStep,
+
+    CollectGarbage,
+    Safepoint,
+    ReadFromTuple,
+    WriteToTuple,
+
+    PrintInt,
+    PrintString,
+    ReadFromStdin,
+    ReadLine,
+
+    MemPush,
+    MemPop,
+    PopRegion,
+
+    GetListLength,
+    AppendToList,
+    WriteBarrier,
+
+    LoadGlobal,
+    StoreGlobal,
+    Call,
+    Return,
+
+    NumOpcodes
+};
+
+
+/// Meaning of an operand word
+enum class Operand {
+    Read,       ///< Object id which is read
+    Write,      ///< Object id which is written
+    Target,     ///< Jump target (offset into code)
+    Constant,   ///< Index into Program::constants
+    Creator,    ///< Index into Program::creators
+    Immediate,  ///< Plain value
+    ReadList,   ///< Number of object ids, followed by the object ids which are read
+    Global,     ///< Object id of the main program, see LoadGlobal
+    GlobalList, ///< Number of global object ids, followed by the object ids
+    Function,   ///< Index into Program::functions
+    Roots,      ///< Index into Program::roots
+};
+
+
+struct OpcodeInfo
+{
+    const char * name;
+    std::vector<Operand> operands;
+};
+
+
+const OpcodeInfo & info(Opcode opcode);
+
+/// Number of words occupied by the instruction at pc, including the opcode
+size_t length(const Word * pc);
+
+/// Whether counter + step < end, for counter < end and a positive step, see AddIntJumpIfLessThan.
+/// The distance to end is computed without sign, s.t. neither side can overflow
+inline bool isStepBelow(int64_t counter, int64_t step, int64_t end)
+{
+    return static_cast<uint64_t>(end) - static_cast<uint64_t>(counter) > static_cast<uint64_t>(step);
+}
+
+/// Call fn(Word & id, Operand operand) for every object id used by the instruction at pc.
+/// operand is Read, Write or Global
+template<typename Fn>
+void forEachObject(Word * pc, Fn fn)
+{
+    Word * operand = pc + 1;
+    for(auto type : info(static_cast<Opcode>(*pc)).operands) {
+        switch( type ) {
+        case Operand::Read:
+        case Operand::Write:
+        case Operand::Global:
+            fn(*operand, type);
+            operand++;
+            break;
+        case Operand::ReadList: {
+            const auto n = *operand++;
+            for(Word i = 0; i < n; i++) fn(*operand++, Operand::Read);
+            break;
+        }
+        case Operand::GlobalList: {
+            const auto n = *operand++;
+            for(Word i = 0; i < n; i++) fn(*operand++, Operand::Global);
+            break;
+        }
+        default:
+            operand++;
+        }
+    }
+}
+
+
+/// Constructs an object in the given memory, see MemoryManager::make
+using Creator = std::function<obj::Allocated *(MemoryManager &)>;
+
+
+/// Objects which keep others alive at a safepoint, see ins::Safepoint.
+/// Not visited by forEachObject, s.t. they do not count as uses of the objects
+struct Roots
+{
+    std::vector<Word> objects;
+    /// Objects of the main program
+    std::vector<Word> globals;
+};
+
+
+/// Every invocation of a function gets a frame of numObjects objects on the value stack.
+/// The first numArguments objects hold the arguments
+struct Function
+{
+    std::string name;
+    /// Offset in code of the first instruction
+    size_t entry = 0;
+    size_t numObjects = 0;
+    size_t numArguments = 0;
+
+    /// Written to the frame before executing the function, see ConstantPool
+    std::vector<std::pair<Word, Object> > literals;
+
+    /// Frame of a new invocation with literals in place, see assemble
+    std::vector<Object> initialFrame;
+};
+
+
+/// Instruction object from which the code at offset was assembled
+struct Origin
+{
+    size_t offset;
+    size_t function;
+    InstructionPointer ip;
+    std::shared_ptr<const Instruction> instruction;
+};
+
+
+/// Source position of the code from offset up to the next entry, line 0 if unknown
+struct Location
+{
+    size_t offset;
+    int line;
+    int column;
+};
+
+
+struct Program
+{
+    std::vector<Word> code;
+
+    std::vector<Object> constants;
+    std::vector<Creator> creators;
+    std::vector<Roots> roots;
+
+    /// The first function is the main program, the others follow it in code
+    std::vector<Function> functions;
+
+    /// Own the interned string literals
+    std::vector<std::shared_ptr<const ConstantPool> > constantPools;
+
+    /// Sorted by offset. Code of inlined functions belongs to the call
+    std::vector<Origin> origins;
+
+    /// nullptr if the code at offset was not assembled from an instruction object, e.g. Halt
+    const Origin * origin(size_t offset) const;
+
+    /// Sorted by offset, see FunctionCode::positions
+    std::vector<Location> locations;
+
+    const Location & location(size_t offset) const;
+
+    /// Index of the function containing offset
+    size_t function(size_t offset) const;
+
+    /// Offset in code after the last instruction of the function
+    size_t end(size_t function) const;
+};
+
+
+/// Translates instruction objects to bytecode, see Instruction::encode.
+/// Functions are assembled in the order in which they are first called
+class Assembler
+{
+public:
+
+    Assembler(const FunctionCode & main);
+
+    void emit(Opcode opcode, const std::vector<size_t> & operands = {});
+
+    /// Call a function, or copy its body into the current function if it is small enough
+    void emitCall(const std::shared_ptr<const FunctionCode> & function, const std::vector<ObjectId> & arguments, ObjectId target);
+
+    Word addConstant(Object value);
+    Word addCreator(Creator creator);
+    Word addRoots(Roots roots);
+
+    /// Called before encoding each instruction s.t. instruction pointers can be mapped to offsets
+    void nextInstruction();
+
+    Program finish();
+
+private:
+
+    /// Index into Program::functions
+    Word addFunction(const FunctionCode & function);
+
+    /// Encode body of function into current function, false if the body is not suited for inlining
+    bool inlineCall(const FunctionCode & function, const std::vector<ObjectId> & arguments, ObjectId target);
+
+    Program mProgram;
+
+    /// Source of each function in Program::functions
+    std::vector<const FunctionCode *> mFunctionCode;
+    std::map<const FunctionCode *, Word> mFunctionIndices;
+
+    /// Index of function which is being assembled
+    size_t mCurrentFunction = 0;
+    bool mInlining = false;
+
+    /// Offset in code for each instruction pointer
+    std::vector<size_t> mOffsets;
+
+    /// Positions in code which hold instruction pointers, to be replaced by offsets
+    std::vector<size_t> mJumps;
+};
+
+
+/// Assemble main program and all functions called by it
+Program assemble(const FunctionCode & main);
+
+/// Renumber objects s.t. objects which are never used do not occupy memory at runtime.
+/// Arguments keep their ids
+void removeUnusedObjects(Program & program);
+
+
+} // namespace bc
@@ -0,0 +1,25 @@
+#include "constantpool.hpp"
+#include "memorymanager.hpp"
+
+
+void ConstantPool::add(ObjectId id, Object value)
+{
+    mValues.emplace_back(id, value);
+}
+
+void ConstantPool::addString(ObjectId id, const std::string &value)
+{
+    mStrings.push_back(std::make_unique<obj::String>(value));
+    MemoryManager::setImmortal(mStrings.back().get());
+
+    Object object;
+    object.as_ptr = mStrings.back().get();
+    add(id, object);
+}
+
+void ConstantPool::initialize(std::vector<Object> &data) const
+{
+    for(const auto & [id, value] : mValues) {
+        data[id] = value;
+    }
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include "common/object.hpp"
+#include "runtime/objects/string.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/// Values of literals, which are written to their objects once before execution.
+/// String literals are interned: all executions of a literal share one immutable string.
+class ConstantPool
+{
+public:
+
+    void add(ObjectId id, Object value);
+    void addString(ObjectId id, const std::string & value);
+
+    /// Write literals to their objects
+    void initialize(std::vector<Object> & data) const;
+
+    const std::vector<std::pair<ObjectId, Object> > & values() const { return mValues; }
+
+private:
+    std::vector<std::pair<ObjectId, Object> > mValues;
+
+    /// Not managed by the memory manager, i.e. never garbage collected
+    std::vector<std::unique_ptr<obj::String> > mStrings;
+};
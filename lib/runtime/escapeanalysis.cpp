@@ -0,0 +1,70 @@
+#include "escapeanalysis.hpp"
+#include "instructions.hpp"
+
+
+EscapeAnalysis::EscapeAnalysis(const InstructionVector &instructions, size_t numObjects, size_t numArguments)
+    : mPlaces(numObjects)
+{
+    for(ObjectId argument = 0; argument < numArguments; argument++) mPlaces[argument] = OUTSIDE;
+
+    // Places only grow, so this ends after a few rounds
+    do {
+        mChanged = false;
+        for(const auto & instruction : instructions) instruction->analyzeEscapes(*this);
+    } while( mChanged && ! mEscapes );
+}
+
+bool EscapeAnalysis::allocates() const
+{
+    for(const auto places : mPlaces) {
+        if( places & REGION ) return true;
+    }
+
+    return false;
+}
+
+void EscapeAnalysis::allocate(ObjectId target)
+{
+    add(target, REGION);
+}
+
+void EscapeAnalysis::load(ObjectId target)
+{
+    add(target, OUTSIDE);
+}
+
+void EscapeAnalysis::copy(ObjectId source, ObjectId target)
+{
+    add(target, mPlaces.at(source));
+}
+
+void EscapeAnalysis::read(ObjectId container, ObjectId target)
+{
+    // Objects in the region may point anywhere
+    const auto places = mPlaces.at(container);
+    add(target, ( places & REGION ) ? REGION | OUTSIDE : places);
+}
+
+void EscapeAnalysis::store(ObjectId container, ObjectId value)
+{
+    if( ( mPlaces.at(container) & OUTSIDE ) && ( mPlaces.at(value) & REGION ) ) mEscapes = true;
+}
+
+void EscapeAnalysis::storeAllocated(ObjectId container)
+{
+    if( mPlaces.at(container) & OUTSIDE ) mEscapes = true;
+}
+
+void EscapeAnalysis::leak(ObjectId value)
+{
+    if( mPlaces.at(value) & REGION ) mEscapes = true;
+}
+
+void EscapeAnalysis::add(ObjectId object, uint8_t places)
+{
+    auto & current = mPlaces.at(object);
+    if( ( current | places ) == current ) return;
+
+    current |= places;
+    mChanged = true;
+}
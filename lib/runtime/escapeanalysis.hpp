@@ -0,0 +1,65 @@
+#pragma once
+#include "bytecode.hpp"
+#include "common/object.hpp"
+
+#include <cstdint>
+#include <vector>
+
+
+/// Finds out whether the objects allocated by an invocation of a function can be reached after it returns,
+/// other than through its return value. If not, they can be deleted at once on return, see ins::PopRegion.
+///
+/// Every object of the function is assigned where its value may point to: into the region of objects
+/// allocated by the current invocation, or outside of it. Instructions report how they move pointers,
+/// see Instruction::analyzeEscapes. The analysis does not follow control flow, every write counts everywhere
+class EscapeAnalysis
+{
+public:
+
+    /// The first numArguments objects hold the arguments, which point outside of the region
+    EscapeAnalysis(const InstructionVector & instructions, size_t numObjects, size_t numArguments);
+
+    /// Objects of the region may be reached from outside after the function returns
+    bool escapes() const { return mEscapes; }
+
+    /// The function allocates objects at all
+    bool allocates() const;
+
+    /// target points to a new object
+    void allocate(ObjectId target);
+
+    /// target points to an object outside of the region, e.g. a global
+    void load(ObjectId target);
+
+    /// target points to whatever source points to
+    void copy(ObjectId source, ObjectId target);
+
+    /// target points to an object which container points to
+    void read(ObjectId container, ObjectId target);
+
+    /// container points to whatever value points to
+    void store(ObjectId container, ObjectId value);
+
+    /// container points to a new object
+    void storeAllocated(ObjectId container);
+
+    /// Anything may point to whatever value points to, e.g. a global
+    void leak(ObjectId value);
+
+    /// Objects of the region are reachable in ways the analysis cannot follow, e.g. by a function which escapes itself
+    void escape() { mEscapes = true; }
+
+private:
+
+    enum Places: uint8_t
+    {
+        REGION = 1,
+        OUTSIDE = 2,
+    };
+
+    void add(ObjectId object, uint8_t places);
+
+    std::vector<uint8_t> mPlaces;
+    bool mChanged = false;
+    bool mEscapes = false;
+};
@@ -1,13 +1,454 @@
 #include "executor.hpp"
+#include "runtime/objects/list.hpp"
+#include "runtime/objects/string.hpp"
+#include <algorithm>
 #include <iostream>
 
-void run(const InstructionVector &instructions, int numObjects)
+
+// Dispatch by jumping through a table of label addresses where the compiler supports it
+#if defined(__GNUC__) && ! defined(GECKO_NO_COMPUTED_GOTO)
+    #define GECKO_COMPUTED_GOTO 1
+#else
+    #define GECKO_COMPUTED_GOTO 0
+#endif
+
+
+Executor::Executor(std::istream &input, std::ostream &output)
+    : mInput(input)
+    , mOutput(output)
+{
+}
+
+void Executor::reset()
+{
+    mMemory.clear();
+    mCalls.clear();
+}
+
+void Executor::run(const FunctionCode &main)
+{
+    reset();
+    mStack.assign(main.numObjects, {});
+    main.constants->initialize(mStack);
+
+    Frame frame {mStack, mStack, *this};
+    try {
+        execute(main, frame);
+    } catch(...) {
+        flushAfterError();
+        throw;
+    }
+    mOutput.flush();
+}
+
+void Executor::flushAfterError()
 {
-    std::vector<Object> data(numObjects);
+    // Whatever the program printed comes before the error is reported, which matters more than an error of the output
+    try {
+        mOutput.flush();
+    } catch(...) {
+    }
+}
 
+void execute(const FunctionCode &function, Frame &frame)
+{
+    const auto & instructions = function.instructions;
     for(size_t ip = 0; ip < instructions.size(); ip++) {
-//        std::cout << "IP=" << ip << std::endl;
         auto & instruction = instructions.at(ip);
-        instruction->call(data, ip);
+        instruction->call(frame, ip);
+    }
+}
+
+template<Executor::Instrumentation instrumentation>
+void Executor::interpret(const bc::Program &program, Profiler * profiler, Sampler * sampler, HeapStatistics * statistics)
+{
+    reset();
+
+    // Frames of all active invocations lie next to each other, the main program comes first.
+    // data points to the frame of the current function and must be updated when the stack grows
+    const auto & mainFrame = program.functions.at(0).initialFrame;
+    if( mStack.size() < mainFrame.size() ) mStack.resize(mainFrame.size());
+    std::copy(mainFrame.begin(), mainFrame.end(), mStack.begin());
+    size_t base = 0;
+    size_t frameSize = mainFrame.size();
+    Object * globals = mStack.data();
+    Object * data = globals;
+    const Object * const constants = program.constants.data();
+    const bc::Word * const code = program.code.data();
+    const bc::Word * pc = code + program.functions.at(0).entry;
+
+    #define PROFILE() \
+        if constexpr ( instrumentation == Instrumentation::Profiler ) profiler->enter(pc - code); \
+        if constexpr ( instrumentation == Instrumentation::Sampler ) sampler->enter(pc - code); \
+        if constexpr ( instrumentation == Instrumentation::Heap ) statistics->enter(pc - code)
+
+#if GECKO_COMPUTED_GOTO
+    static const void * const labels[] = {
+        &&op_Halt,
+        &&op_SetInt, &&op_SetFloat, &&op_SetBoolean, &&op_SetAllocated,
+        &&op_AddInt, &&op_AddIntImmediate,
+        &&op_IntLessThan, &&op_IntLTE, &&op_IsEqual, &&op_IsNotEqual, &&op_IntGTE, &&op_IntGreaterThan,
+        &&op_OrTest, &&op_AndTest, &&op_Negate,
+        &&op_Copy, &&op_Jump, &&op_JumpIf, &&op_JumpIfNot,
+        &&op_JumpIfNotIntLessThan, &&op_JumpIfNotIntLTE, &&op_JumpIfNotIsEqual, &&op_JumpIfNotIsNotEqual,
+        &&op_AddIntJumpIfLessThan, &&op_CheckStep,
+        &&op_CollectGarbage, &&op_Safepoint, &&op_ReadFromTuple, &&op_WriteToTuple,
+        &&op_PrintInt, &&op_PrintString, &&op_ReadFromStdin, &&op_ReadLine,
+        &&op_MemPush, &&op_MemPop, &&op_PopRegion,
+        &&op_GetListLength, &&op_AppendToList, &&op_WriteBarrier,
+        &&op_LoadGlobal, &&op_StoreGlobal, &&op_Call, &&op_Return,
+    };
+    static_assert(sizeof(labels) / sizeof(labels[0]) == bc::NumOpcodes, "Label table does not match opcodes");
+
+    #define DISPATCH() { PROFILE(); goto *labels[*pc]; }
+    #define CASE(opcode) op_##opcode:
+
+    DISPATCH();
+#else
+    #define DISPATCH() { PROFILE(); continue; }
+    #define CASE(opcode) case bc::opcode:
+
+    for(;;) switch( static_cast<bc::Opcode>(*pc) ) {
+    case bc::NumOpcodes:
+        throw CompilerBug { "Invalid opcode" };
+#endif
+
+    CASE(Halt)
+        if constexpr ( instrumentation == Instrumentation::Profiler ) profiler->stop();
+        if constexpr ( instrumentation == Instrumentation::Heap ) statistics->stop();
+        mOutput.flush();
+        return;
+
+    CASE(SetInt)
+    CASE(SetFloat)
+        data[pc[1]] = constants[pc[2]];
+        pc += 3;
+        DISPATCH();
+
+    CASE(SetBoolean)
+        data[pc[1]].as_boolean = pc[2];
+        pc += 3;
+        DISPATCH();
+
+    CASE(SetAllocated)
+        data[pc[1]].as_ptr = program.creators[pc[2]](mMemory);
+        pc += 3;
+        DISPATCH();
+
+    CASE(AddInt)
+        data[pc[3]].as_int = data[pc[1]].as_int + data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(AddIntImmediate)
+        data[pc[3]].as_int = data[pc[1]].as_int + constants[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IntLessThan)
+        data[pc[3]].as_boolean = data[pc[1]].as_int < data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IntLTE)
+        data[pc[3]].as_boolean = data[pc[1]].as_int <= data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IsEqual)
+        data[pc[3]].as_boolean = data[pc[1]].as_int == data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IsNotEqual)
+        data[pc[3]].as_boolean = data[pc[1]].as_int != data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IntGTE)
+        data[pc[3]].as_boolean = data[pc[1]].as_int >= data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(IntGreaterThan)
+        data[pc[3]].as_boolean = data[pc[1]].as_int > data[pc[2]].as_int;
+        pc += 4;
+        DISPATCH();
+
+    CASE(OrTest)
+        data[pc[3]].as_boolean = data[pc[1]].as_boolean || data[pc[2]].as_boolean;
+        pc += 4;
+        DISPATCH();
+
+    CASE(AndTest)
+        data[pc[3]].as_boolean = data[pc[1]].as_boolean && data[pc[2]].as_boolean;
+        pc += 4;
+        DISPATCH();
+
+    CASE(Negate)
+        data[pc[2]].as_boolean = ! data[pc[1]].as_boolean;
+        pc += 3;
+        DISPATCH();
+
+    CASE(Copy)
+        data[pc[2]] = data[pc[1]];
+        pc += 3;
+        DISPATCH();
+
+    CASE(Jump)
+        pc = code + pc[1];
+        DISPATCH();
+
+    CASE(JumpIf)
+        pc = data[pc[1]].as_boolean ? code + pc[2] : pc + 3;
+        DISPATCH();
+
+    CASE(JumpIfNot)
+        pc = data[pc[1]].as_boolean ? pc + 3 : code + pc[2];
+        DISPATCH();
+
+    CASE(JumpIfNotIntLessThan)
+        pc = data[pc[1]].as_int < data[pc[2]].as_int ? pc + 4 : code + pc[3];
+        DISPATCH();
+
+    CASE(JumpIfNotIntLTE)
+        pc = data[pc[1]].as_int <= data[pc[2]].as_int ? pc + 4 : code + pc[3];
+        DISPATCH();
+
+    CASE(JumpIfNotIsEqual)
+        pc = data[pc[1]].as_int == data[pc[2]].as_int ? pc + 4 : code + pc[3];
+        DISPATCH();
+
+    CASE(JumpIfNotIsNotEqual)
+        pc = data[pc[1]].as_int != data[pc[2]].as_int ? pc + 4 : code + pc[3];
+        DISPATCH();
+
+    CASE(AddIntJumpIfLessThan) {
+        const auto counter = data[pc[1]].as_int;
+        const auto step = data[pc[2]].as_int;
+        if( bc::isStepBelow(counter, step, data[pc[3]].as_int) ) {
+            data[pc[4]].as_int = counter + step;
+            pc = code + pc[5];
+        } else {
+            pc += 6;
+        }
+        DISPATCH();
+    }
+
+    CASE(CheckStep)
+        if( data[pc[1]].as_int <= 0 ) {
+            throw InvalidStep({static_cast<int>(pc[2]), static_cast<int>(pc[3])}, data[pc[1]].as_int);
+        }
+        pc += 4;
+        DISPATCH();
+
+    CASE(CollectGarbage) {
+        mMemory.beginCollection();
+        const auto n = pc[1];
+        for(bc::Word i = 0; i < n; i++) {
+            mMemory.mark(data[pc[2 + i]].as_ptr);
+        }
+        const auto numGlobals = pc[2 + n];
+        for(bc::Word i = 0; i < numGlobals; i++) {
+            mMemory.mark(globals[pc[3 + n + i]].as_ptr);
+        }
+        mMemory.collectGarbage();
+        pc += 3 + n + numGlobals;
+        DISPATCH();
+    }
+
+    CASE(Safepoint) {
+        if( pc[2] || mMemory.needsCollection() ) {
+            const auto & roots = program.roots[pc[1]];
+            mMemory.beginCollection();
+            for(const auto id : roots.objects) {
+                mMemory.mark(data[id].as_ptr);
+            }
+            for(const auto id : roots.globals) {
+                mMemory.mark(globals[id].as_ptr);
+            }
+            mMemory.collectGarbage();
+        }
+        pc += 3;
+        DISPATCH();
+    }
+
+    CASE(ReadFromTuple) {
+        auto tuple = static_cast<obj::Tuple<2> *>(data[pc[1]].as_ptr);
+        data[pc[3]] = tuple->data[pc[2]];
+        pc += 4;
+        DISPATCH();
+    }
+
+    CASE(WriteToTuple) {
+        auto tuple = static_cast<obj::Tuple<2> *>(data[pc[1]].as_ptr);
+        tuple->data[pc[2]] = data[pc[3]];
+        pc += 4;
+        DISPATCH();
+    }
+
+    CASE(PrintInt)
+        mOutput.printLine(data[pc[1]].as_int);
+        pc += 2;
+        DISPATCH();
+
+    CASE(PrintString)
+        mOutput.printLine(static_cast<obj::String*>(data[pc[1]].as_ptr)->value());
+        pc += 2;
+        DISPATCH();
+
+    CASE(ReadFromStdin)
+        ins::ReadFromStdin::read(static_cast<obj::Tuple<2>*>(data[pc[1]].as_ptr), *this);
+        pc += 2;
+        DISPATCH();
+
+    CASE(ReadLine)
+        ins::ReadLine::read(data[pc[1]], data[pc[2]], *this);
+        pc += 3;
+        DISPATCH();
+
+    CASE(MemPush)
+        mMemory.push();
+        pc += 1;
+        DISPATCH();
+
+    CASE(MemPop)
+        mMemory.pop();
+        pc += 1;
+        DISPATCH();
+
+    CASE(PopRegion)
+        mMemory.popRegion(pc[1] ? &data[pc[2]].as_ptr : nullptr);
+        pc += 2 + pc[1];
+        DISPATCH();
+
+    CASE(GetListLength)
+        data[pc[2]].as_int = static_cast<obj::List*>(data[pc[1]].as_ptr)->mItems.size();
+        pc += 3;
+        DISPATCH();
+
+    CASE(AppendToList)
+        static_cast<obj::List*>(data[pc[1]].as_ptr)->mItems.push_back(data[pc[2]]);
+        pc += 3;
+        DISPATCH();
+
+    CASE(WriteBarrier)
+        mMemory.writeBarrier(data[pc[1]].as_ptr);
+        pc += 2;
+        DISPATCH();
+
+    CASE(LoadGlobal)
+        data[pc[2]] = globals[pc[1]];
+        pc += 3;
+        DISPATCH();
+
+    CASE(StoreGlobal)
+        globals[pc[2]] = data[pc[1]];
+        pc += 3;
+        DISPATCH();
+
+    CASE(Call) {
+        const auto & initialFrame = program.functions[pc[1]].initialFrame;
+        const auto numArguments = pc[3];
+        const auto calleeBase = base + frameSize;
+        if( calleeBase + initialFrame.size() > mStack.size() ) {
+            mStack.resize(2 * (calleeBase + initialFrame.size()));
+            globals = mStack.data();
+            data = globals + base;
+        }
+
+        Object * const callee = globals + calleeBase;
+        std::copy(initialFrame.begin(), initialFrame.end(), callee);
+        for(bc::Word i = 0; i < numArguments; i++) {
+            callee[i] = data[pc[4 + i]];
+        }
+
+        if constexpr ( instrumentation == Instrumentation::Sampler ) sampler->push(pc - code);
+        mCalls.push_back({pc + 4 + numArguments, base, frameSize, pc[2]});
+        base = calleeBase;
+        frameSize = initialFrame.size();
+        data = callee;
+        pc = code + program.functions[pc[1]].entry;
+        DISPATCH();
+    }
+
+    CASE(Return) {
+        const auto returnValue = data[pc[1]];
+        const auto & caller = mCalls.back();
+        base = caller.base;
+        frameSize = caller.frameSize;
+        data = globals + base;
+        data[caller.target] = returnValue;
+        pc = caller.returnPc;
+        mCalls.pop_back();
+        if constexpr ( instrumentation == Instrumentation::Sampler ) sampler->pop();
+        DISPATCH();
     }
+
+#if ! GECKO_COMPUTED_GOTO
+    }
+#endif
+
+    #undef PROFILE
+    #undef DISPATCH
+    #undef CASE
+}
+
+void Executor::run(const bc::Program &program)
+{
+    try {
+        interpret<Instrumentation::None>(program, nullptr, nullptr, nullptr);
+    } catch(...) {
+        flushAfterError();
+        throw;
+    }
+}
+
+void Executor::run(const bc::Program &program, Profiler &profiler)
+{
+    try {
+        interpret<Instrumentation::Profiler>(program, &profiler, nullptr, nullptr);
+    } catch(...) {
+        flushAfterError();
+        throw;
+    }
+}
+
+void Executor::run(const bc::Program &program, Sampler &sampler)
+{
+    sampler.start();
+    try {
+        interpret<Instrumentation::Sampler>(program, nullptr, &sampler, nullptr);
+    } catch(...) {
+        sampler.stop();
+        flushAfterError();
+        throw;
+    }
+    sampler.stop();
+}
+
+void Executor::run(const bc::Program &program, HeapStatistics &statistics)
+{
+    mMemory.setStatistics(&statistics);
+    try {
+        interpret<Instrumentation::Heap>(program, nullptr, nullptr, &statistics);
+    } catch(...) {
+        mMemory.setStatistics(nullptr);
+        flushAfterError();
+        throw;
+    }
+    mMemory.setStatistics(nullptr);
+}
+
+
+void run(const FunctionCode &main)
+{
+    Executor executor;
+    executor.run(main);
+}
+
+void run(const bc::Program &program)
+{
+    Executor executor;
+    executor.run(program);
 }
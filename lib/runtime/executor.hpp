@@ -1,7 +1,91 @@
 #pragma once
+#include "bytecode.hpp"
+#include "heapstatistics.hpp"
 #include "instructions.hpp"
+#include "linereader.hpp"
+#include "memorymanager.hpp"
+#include "outputwriter.hpp"
+#include "profiler.hpp"
+#include "sampler.hpp"
 
+#include <iostream>
 #include <memory>
 #include <vector>
 
-void run(const InstructionVector &instructions, int numObjectIds);
+
+/// Executes compiled programs.
+///
+/// Owns the heap, the value stack and the I/O streams. Buffers are kept between runs,
+/// s.t. a program compiled once can be executed many times without allocating anew.
+class Executor
+{
+public:
+
+    Executor(std::istream & input = std::cin, std::ostream & output = std::cout);
+
+    LineReader & input() { return mInput; }
+    OutputWriter & output() { return mOutput; }
+    MemoryManager & memory() { return mMemory; }
+
+    /// Used by subsequent runs
+    void setInput(std::istream & input) { mInput.reset(input); }
+    void setOutput(std::ostream & output) { mOutput.reset(output); }
+
+    /// Execute instruction objects one by one
+    void run(const FunctionCode & main);
+
+    /// Execute flat bytecode, see bc::assemble
+    void run(const bc::Program & program);
+
+    /// Same as run(program), but count executions and cycles of every instruction
+    void run(const bc::Program & program, Profiler & profiler);
+
+    /// Same as run(program), but periodically record the call stack
+    void run(const bc::Program & program, Sampler & sampler);
+
+    /// Same as run(program), but record allocations per instruction and the pauses for garbage collection.
+    /// The objects of the program are kept until the next run, see MemoryManager::census
+    void run(const bc::Program & program, HeapStatistics & statistics);
+
+    /// Delete all objects of previous runs. Every run starts with a reset
+    void reset();
+
+private:
+
+    /// What the interpreter reports while executing
+    enum class Instrumentation { None, Profiler, Sampler, Heap };
+
+    /// Separate instantiations s.t. instrumentation costs nothing when it is disabled
+    template<Instrumentation instrumentation>
+    void interpret(const bc::Program & program, Profiler * profiler, Sampler * sampler, HeapStatistics * statistics);
+
+    /// Flush mOutput while an exception is being thrown, ignoring errors of the output itself
+    void flushAfterError();
+
+    /// Where to continue after ins::Return
+    struct CallRecord
+    {
+        const bc::Word * returnPc;
+        size_t base;
+        size_t frameSize;
+        bc::Word target;
+    };
+
+    /// Kept between runs like the stream it reads
+    LineReader mInput;
+    /// Flushed at the end of every run, also if the program throws
+    OutputWriter mOutput;
+    MemoryManager mMemory;
+
+    /// Frames of all active invocations, the main program comes first
+    std::vector<Object> mStack;
+    std::vector<CallRecord> mCalls;
+};
+
+
+/// Execute instructions of function in the given frame, see ins::Call
+void execute(const FunctionCode & function, Frame & frame);
+
+/// Shorthands for a single run with a new executor on std::cin and std::cout
+void run(const FunctionCode & main);
+void run(const bc::Program & program);
@@ -0,0 +1,148 @@
+#include "heapstatistics.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <iomanip>
+
+
+namespace {
+
+    void writeString(std::ostream & stream, const std::string & text)
+    {
+        stream << '"';
+        for(const auto c : text) {
+            if( c == '"' || c == '\\' ) {
+                stream << '\\' << c;
+            } else if( static_cast<unsigned char>(c) < 0x20 ) {
+                stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec << std::setfill(' ');
+            } else {
+                stream << c;
+            }
+        }
+        stream << '"';
+    }
+
+    double microseconds(std::chrono::nanoseconds duration)
+    {
+        return duration.count() / 1000.0;
+    }
+
+    const char * name(HeapStatistics::Pause pause)
+    {
+        switch( pause ) {
+        case HeapStatistics::Pause::Nursery: return "nursery";
+        case HeapStatistics::Pause::Slice: return "slice";
+        case HeapStatistics::Pause::Full: return "full";
+        case HeapStatistics::Pause::Compaction: return "compaction";
+        case HeapStatistics::Pause::NumPauses: break;
+        }
+
+        return "";
+    }
+
+}
+
+
+HeapStatistics::HeapStatistics(const bc::Program *program)
+    : mProgram(program)
+    , mSites(program ? program->code.size() + 1 : 1)
+    , mSite(mSites.size() - 1)
+{
+}
+
+void HeapStatistics::collected(Pause pause, std::chrono::nanoseconds duration, size_t reclaimedBytes)
+{
+    auto & pauses = mPauses.at(static_cast<size_t>(pause));
+    pauses.count++;
+    pauses.total += duration;
+    pauses.longest = std::max(pauses.longest, duration);
+
+    size_t bucket = 0;
+    for(auto limit = std::chrono::nanoseconds {1000}; bucket + 1 < numBuckets && duration > limit; limit *= 2) bucket++;
+    pauses.histogram[bucket]++;
+
+    mReclaimedBytes += reclaimedBytes;
+}
+
+uint64_t HeapStatistics::numCollections() const
+{
+    uint64_t ret = 0;
+    for(const auto & pauses : mPauses) ret += pauses.count;
+
+    return ret;
+}
+
+void HeapStatistics::writeJson(std::ostream &stream, const std::vector<Count> &held) const
+{
+    stream << "{\n  \"collections\": " << numCollections() << ",\n"
+           << "  \"reclaimed_bytes\": " << mReclaimedBytes << ",\n"
+           << "  \"pauses\": {";
+    for(size_t i = 0; i < mPauses.size(); i++) {
+        const auto & pauses = mPauses[i];
+        stream << ( i ? "," : "" ) << "\n    \"" << name(static_cast<Pause>(i)) << "\": {"
+               << "\"count\": " << pauses.count << ", "
+               << "\"total_microseconds\": " << microseconds(pauses.total) << ", "
+               << "\"longest_microseconds\": " << microseconds(pauses.longest) << ", "
+               << "\"histogram\": [";
+
+        // Buckets up to the last one in use, each given by its upper bound
+        auto used = numBuckets;
+        while( used > 0 && ! pauses.histogram[used - 1] ) used--;
+        for(size_t bucket = 0; bucket < used; bucket++) {
+            stream << ( bucket ? ", " : "" ) << "{\"up_to_microseconds\": ";
+            if( bucket + 1 < numBuckets ) {
+                stream << ( uint64_t {1} << bucket );
+            } else {
+                stream << "null";
+            }
+            stream << ", \"count\": " << pauses.histogram[bucket] << "}";
+        }
+        stream << "]}";
+    }
+    stream << "\n  },\n  \"types\": [";
+
+    bool first = true;
+    for(size_t type = 0; type < std::max(mTypes.size(), held.size()); type++) {
+        const auto allocated = type < mTypes.size() ? mTypes[type] : Count {};
+        const auto live = type < held.size() ? held[type] : Count {};
+        if( ! allocated.objects && ! live.objects ) continue;
+
+        stream << ( first ? "" : "," ) << "\n    {\"name\": ";
+        writeString(stream, obj::descriptor(static_cast<obj::TypeIndex>(type)).name);
+        stream << ", \"allocated_objects\": " << allocated.objects
+               << ", \"allocated_bytes\": " << allocated.bytes
+               << ", \"held_objects\": " << live.objects
+               << ", \"held_bytes\": " << live.bytes << "}";
+        first = false;
+    }
+    stream << "\n  ],\n  \"sites\": [";
+
+    // Sites allocating the most bytes first
+    std::vector<size_t> sites;
+    for(size_t offset = 0; offset < mSites.size(); offset++) {
+        if( mSites[offset].objects ) sites.push_back(offset);
+    }
+    std::stable_sort(sites.begin(), sites.end(), [this](size_t a, size_t b) { return mSites[a].bytes > mSites[b].bytes; });
+
+    first = true;
+    for(const auto offset : sites) {
+        stream << ( first ? "" : "," ) << "\n    {";
+        if( offset + 1 < mSites.size() ) {
+            const auto & location = mProgram->location(offset);
+            stream << "\"offset\": " << offset << ", \"opcode\": ";
+            writeString(stream, bc::info(static_cast<bc::Opcode>(mProgram->code[offset])).name);
+            stream << ", \"function\": ";
+            writeString(stream, mProgram->functions[mProgram->function(offset)].name);
+            stream << ", \"line\": " << location.line;
+            if( const auto origin = mProgram->origin(offset) ) {
+                stream << ", \"instruction\": ";
+                writeString(stream, origin->instruction->toString());
+            }
+        } else {
+            stream << "\"offset\": null";
+        }
+        stream << ", \"objects\": " << mSites[offset].objects << ", \"bytes\": " << mSites[offset].bytes << "}";
+        first = false;
+    }
+    stream << "\n  ]\n}\n";
+}
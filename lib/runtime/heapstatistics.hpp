@@ -0,0 +1,99 @@
+#pragma once
+#include "bytecode.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+
+/// Allocations per type and per bytecode offset, and the pauses of every collection.
+///
+/// Filled by a MemoryManager while set with MemoryManager::setStatistics. Allocations are attributed
+/// to the instruction which is executing, see run(const bc::Program &, HeapStatistics &)
+class HeapStatistics
+{
+public:
+
+    struct Count
+    {
+        uint64_t objects = 0;
+        uint64_t bytes = 0;
+    };
+
+    /// What a collection did, see MemoryManager::collectGarbage
+    enum class Pause
+    {
+        /// Moved survivors out of the nursery
+        Nursery,
+        /// Also marked or swept a slice of the arena, see MemoryManager::setSliceBudget
+        Slice,
+        /// Also marked and swept all of the arena
+        Full,
+        /// Also moved the survivors in the arena next to each other, see MemoryManager::setCompaction
+        Compaction,
+        NumPauses
+    };
+
+    /// Pauses up to 2^i microseconds count towards bucket i, longer ones towards the last bucket
+    static constexpr size_t numBuckets = 24;
+
+    struct Pauses
+    {
+        uint64_t count = 0;
+        std::chrono::nanoseconds total {0};
+        std::chrono::nanoseconds longest {0};
+        std::array<uint64_t, numBuckets> histogram {};
+    };
+
+    /// Without a program, allocations cannot be told apart by site
+    explicit HeapStatistics(const bc::Program * program = nullptr);
+
+    /// Called by the interpreter before executing the instruction at offset
+    void enter(size_t offset) { mSite = offset; }
+
+    /// Called when execution ends, s.t. later allocations are not attributed to the last instruction
+    void stop() { mSite = mSites.size() - 1; }
+
+    void allocated(obj::TypeIndex type, size_t bytes)
+    {
+        if( type >= mTypes.size() ) mTypes.resize(type + 1);
+        auto & perType = mTypes[type];
+        perType.objects++;
+        perType.bytes += bytes;
+
+        auto & site = mSites[mSite];
+        site.objects++;
+        site.bytes += bytes;
+    }
+
+    void collected(Pause pause, std::chrono::nanoseconds duration, size_t reclaimedBytes);
+
+    /// Allocations per type, indexed by obj::TypeIndex
+    const std::vector<Count> & types() const { return mTypes; }
+
+    /// Allocations of the instruction at offset, the last entry counts allocations outside of the program
+    const Count & site(size_t offset) const { return mSites.at(offset); }
+
+    const Pauses & pauses(Pause pause) const { return mPauses.at(static_cast<size_t>(pause)); }
+
+    uint64_t numCollections() const;
+    uint64_t reclaimedBytes() const { return mReclaimedBytes; }
+
+    /// Everything as JSON, together with the objects held per type, see MemoryManager::census
+    void writeJson(std::ostream & stream, const std::vector<Count> & held) const;
+
+private:
+
+    const bc::Program * const mProgram;
+
+    std::vector<Count> mTypes;
+
+    /// One entry per offset, the last one stands for allocations outside of the program
+    std::vector<Count> mSites;
+    size_t mSite;
+
+    std::array<Pauses, static_cast<size_t>(Pause::NumPauses)> mPauses;
+    uint64_t mReclaimedBytes = 0;
+};
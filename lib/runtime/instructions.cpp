@@ -1,10 +1,9 @@
 #include "instructions.hpp"
-#include "instructions.hpp"
+#include "executor.hpp"
 #include <runtime/memorymanager.hpp>
 #include "runtime/objects/string.hpp"
 #include "runtime/objects/tuple.hpp"
 #include "runtime/objects/list.hpp"
-#include "runtime/output.hpp"
 
 #include <sstream>
 
@@ -20,9 +19,16 @@ SetInt::SetInt(ObjectId target, int64_t value)
 
 std::string SetInt::toString() const { return "SetInt target=" + std::to_string(mTarget) + " value=" + std::to_string(mValue); }
 
-void SetInt::call(std::vector<Object> &data, InstructionPointer &ip) const
+void SetInt::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_int = mValue;
+    frame[mTarget].as_int = mValue;
+}
+
+void SetInt::encode(bc::Assembler &assembler) const
+{
+    Object value;
+    value.as_int = mValue;
+    assembler.emit(bc::SetInt, {mTarget, assembler.addConstant(value)});
 }
 
 AddInt::AddInt(ObjectId left, ObjectId right, ObjectId target)
@@ -38,9 +44,53 @@ std::string AddInt::toString() const
     return "AddInt left=" + std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget);
 }
 
-void AddInt::call(std::vector<Object> &data, InstructionPointer &ip) const
+void AddInt::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_int = frame[mLeft].as_int + frame[mRight].as_int;
+}
+
+void AddInt::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::AddInt, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> AddInt::retarget(ObjectId oldTarget, ObjectId newTarget) const
 {
-    data[mTarget].as_int = data[mLeft].as_int + data[mRight].as_int;
+    if( mTarget != oldTarget ) return nullptr;
+
+    return std::make_shared<AddInt>(mLeft, mRight, newTarget);
+}
+
+AddIntImmediate::AddIntImmediate(ObjectId left, int64_t value, ObjectId target)
+    : mLeft(left)
+    , mValue(value)
+    , mTarget(target)
+{
+
+}
+
+std::string AddIntImmediate::toString() const
+{
+    return "AddIntImmediate left=" + std::to_string(mLeft) + " value=" + std::to_string(mValue) + " target=" + std::to_string(mTarget);
+}
+
+void AddIntImmediate::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_int = frame[mLeft].as_int + mValue;
+}
+
+void AddIntImmediate::encode(bc::Assembler &assembler) const
+{
+    Object value;
+    value.as_int = mValue;
+    assembler.emit(bc::AddIntImmediate, {mLeft, assembler.addConstant(value), mTarget});
+}
+
+std::shared_ptr<const Instruction> AddIntImmediate::retarget(ObjectId oldTarget, ObjectId newTarget) const
+{
+    if( mTarget != oldTarget ) return nullptr;
+
+    return std::make_shared<AddIntImmediate>(mLeft, mValue, newTarget);
 }
 
 
@@ -53,9 +103,14 @@ IntGte::IntGte(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IntGte::toString() const { return "IntGte left=" + std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IntGte::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IntGte::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int >= data[mRight].as_int;
+    frame[mTarget].as_boolean = frame[mLeft].as_int >= frame[mRight].as_int;
+}
+
+void IntGte::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::IntGTE, {mLeft, mRight, mTarget});
 }
 
 JumpIf::JumpIf(ObjectId condition, InstructionPointer ipNew)
@@ -67,9 +122,14 @@ JumpIf::JumpIf(ObjectId condition, InstructionPointer ipNew)
 
 std::string JumpIf::toString() const { return "JumpIf condition=" + std::to_string(mCondition) +  " ip=" + std::to_string(mIpNew); }
 
-void JumpIf::call(std::vector<Object> &data, InstructionPointer &ip) const
+void JumpIf::call(Frame &frame, InstructionPointer &ip) const
 {
-    if( data[mCondition].as_boolean ) ip = mIpNew - 1;
+    if( frame[mCondition].as_boolean ) ip = mIpNew - 1;
+}
+
+void JumpIf::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::JumpIf, {mCondition, mIpNew});
 }
 
 
@@ -82,9 +142,14 @@ JumpIfNot::JumpIfNot(ObjectId condition, InstructionPointer ipNew)
 
 std::string JumpIfNot::toString() const { return "JumpIfNot condition=" + std::to_string(mCondition) +  " ip=" + std::to_string(mIpNew); }
 
-void JumpIfNot::call(std::vector<Object> &data, InstructionPointer &ip) const
+void JumpIfNot::call(Frame &frame, InstructionPointer &ip) const
+{
+    if( ! frame[mCondition].as_boolean ) ip = mIpNew - 1;
+}
+
+void JumpIfNot::encode(bc::Assembler &assembler) const
 {
-    if( ! data[mCondition].as_boolean ) ip = mIpNew - 1;
+    assembler.emit(bc::JumpIfNot, {mCondition, mIpNew});
 }
 
 Jump::Jump(InstructionPointer ipNew)
@@ -94,11 +159,67 @@ Jump::Jump(InstructionPointer ipNew)
 
 std::string Jump::toString() const { return "Jump " + std::to_string(mIpNew); }
 
-void Jump::call(std::vector<Object> &data, InstructionPointer &ip) const
+void Jump::call(Frame & /* frame */, InstructionPointer &ip) const
 {
     ip = mIpNew - 1;
 }
 
+void Jump::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::Jump, {mIpNew});
+}
+
+AddIntJumpIfLessThan::AddIntJumpIfLessThan(ObjectId counter, ObjectId step, ObjectId end, ObjectId target, InstructionPointer ipNew)
+    : mCounter(counter)
+    , mStep(step)
+    , mEnd(end)
+    , mTarget(target)
+    , mIpNew(ipNew)
+{
+
+}
+
+std::string AddIntJumpIfLessThan::toString() const
+{
+    return "AddIntJumpIfLessThan counter=" + std::to_string(mCounter) + " step=" + std::to_string(mStep)
+        + " end=" + std::to_string(mEnd) + " target=" + std::to_string(mTarget) + " ip=" + std::to_string(mIpNew);
+}
+
+void AddIntJumpIfLessThan::call(Frame &frame, InstructionPointer &ip) const
+{
+    const auto counter = frame[mCounter].as_int;
+    const auto step = frame[mStep].as_int;
+    if( bc::isStepBelow(counter, step, frame[mEnd].as_int) ) {
+        frame[mTarget].as_int = counter + step;
+        ip = mIpNew - 1;
+    }
+}
+
+void AddIntJumpIfLessThan::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::AddIntJumpIfLessThan, {mCounter, mStep, mEnd, mTarget, mIpNew});
+}
+
+CheckStep::CheckStep(ObjectId step, Position position)
+    : mStep(step)
+    , mPosition(position)
+{
+
+}
+
+std::string CheckStep::toString() const { return "CheckStep step=" + std::to_string(mStep); }
+
+void CheckStep::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    const auto step = frame[mStep].as_int;
+    if( step <= 0 ) throw InvalidStep(mPosition, step);
+}
+
+void CheckStep::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::CheckStep, {mStep, static_cast<bc::Word>(mPosition.lineNumber), static_cast<bc::Word>(mPosition.column)});
+}
+
 Copy::Copy(ObjectId source, ObjectId target)
     : mSource(source)
     , mTarget(target)
@@ -107,9 +228,19 @@ Copy::Copy(ObjectId source, ObjectId target)
 
 std::string Copy::toString() const { return "Copy source=" + std::to_string(mSource) + " target=" + std::to_string(mTarget); }
 
-void Copy::call(std::vector<Object> &data, InstructionPointer &ip) const
+void Copy::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget] = data[mSource];
+    frame[mTarget] = frame[mSource];
+}
+
+void Copy::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::Copy, {mSource, mTarget});
+}
+
+void Copy::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.copy(mSource, mTarget);
 }
 
 IntLessThan::IntLessThan(ObjectId left, ObjectId right, ObjectId target)
@@ -121,9 +252,21 @@ IntLessThan::IntLessThan(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IntLessThan::toString() const { return "IntLessThan left=" + std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IntLessThan::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IntLessThan::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int < data[mRight].as_int;
+    frame[mTarget].as_boolean = frame[mLeft].as_int < frame[mRight].as_int;
+}
+
+void IntLessThan::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::IntLessThan, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> IntLessThan::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
+{
+    if( mTarget != condition ) return nullptr;
+
+    return std::make_shared<JumpIfNotIntLessThan>(mLeft, mRight, ipNew);
 }
 
 Negate::Negate(ObjectId source, ObjectId target)
@@ -134,20 +277,30 @@ Negate::Negate(ObjectId source, ObjectId target)
 
 std::string Negate::toString() const { return "Negate source=" + std::to_string(mSource) + " target=" + std::to_string(mTarget); }
 
-void Negate::call(std::vector<Object> &data, InstructionPointer &ip) const
+void Negate::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = ! data[mSource].as_boolean;
+    frame[mTarget].as_boolean = ! frame[mSource].as_boolean;
+}
+
+void Negate::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::Negate, {mSource, mTarget});
 }
 
 Noop::Noop() {}
 
 std::string Noop::toString() const { return "Noop"; }
 
-void Noop::call(std::vector<Object> &data, InstructionPointer &ip) const
+void Noop::call(Frame & /* frame */, InstructionPointer & /* ip */) const
 {
     // Nothing to do.
 }
 
+void Noop::encode(bc::Assembler & /* assembler */) const
+{
+    // Jumps to a noop will land on the next instruction
+}
+
 SetFloat::SetFloat(ObjectId target, double value)
     : mTarget(target)
     , mValue(value)
@@ -156,9 +309,16 @@ SetFloat::SetFloat(ObjectId target, double value)
 
 std::string SetFloat::toString() const { return "SetFloat target=" + std::to_string(mTarget) + " target=" + std::to_string(mValue); }
 
-void SetFloat::call(std::vector<Object> &data, InstructionPointer &ip) const
+void SetFloat::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_float = mValue;
+    frame[mTarget].as_float = mValue;
+}
+
+void SetFloat::encode(bc::Assembler &assembler) const
+{
+    Object value;
+    value.as_float = mValue;
+    assembler.emit(bc::SetFloat, {mTarget, assembler.addConstant(value)});
 }
 
 
@@ -167,9 +327,19 @@ std::string SetAllocated::toString() const
     return "SetFunction target=" + std::to_string(mTarget);
 }
 
-void SetAllocated::call(std::vector<Object> &data, InstructionPointer &ip) const
+void SetAllocated::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_ptr = mCreator(frame.executor.memory());
+}
+
+void SetAllocated::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::SetAllocated, {mTarget, assembler.addCreator(mCreator)});
+}
+
+void SetAllocated::analyzeEscapes(EscapeAnalysis &analysis) const
 {
-    data[mTarget].as_ptr = memory().add(mCreator());
+    analysis.allocate(mTarget);
 }
 
 SetAllocated::~SetAllocated() {}
@@ -182,22 +352,14 @@ SetBoolean::SetBoolean(ObjectId target, bool value)
 
 std::string SetBoolean::toString() const { return "SetBoolean target=" + std::to_string(mTarget) + " value=" + std::to_string(mValue); }
 
-void SetBoolean::call(std::vector<Object> &data, InstructionPointer &ip) const
+void SetBoolean::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = mValue;
+    frame[mTarget].as_boolean = mValue;
 }
 
-SetString::SetString(ObjectId target, const std::string & value)
-    : mTarget(target)
-    , mValue(value)
-{
-}
-
-std::string SetString::toString() const { return "SetString target=" + std::to_string(mTarget) + " value=" + mValue; }
-
-void SetString::call(std::vector<Object> &data, InstructionPointer &ip) const
+void SetBoolean::encode(bc::Assembler &assembler) const
 {
-    data[mTarget].as_ptr = memory().add(std::make_unique<obj::String>(mValue));
+    assembler.emit(bc::SetBoolean, {mTarget, mValue});
 }
 
 OrTest::OrTest(ObjectId left, ObjectId right, ObjectId target)
@@ -209,9 +371,14 @@ OrTest::OrTest(ObjectId left, ObjectId right, ObjectId target)
 
 std::string OrTest::toString() const { return "OrTest left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void OrTest::call(std::vector<Object> &data, InstructionPointer &ip) const
+void OrTest::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_boolean || data[mRight].as_boolean;
+    frame[mTarget].as_boolean = frame[mLeft].as_boolean || frame[mRight].as_boolean;
+}
+
+void OrTest::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::OrTest, {mLeft, mRight, mTarget});
 }
 
 AndTest::AndTest(ObjectId left, ObjectId right, ObjectId target)
@@ -223,9 +390,14 @@ AndTest::AndTest(ObjectId left, ObjectId right, ObjectId target)
 
 std::string AndTest::toString() const { return "AndTest left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void AndTest::call(std::vector<Object> &data, InstructionPointer &ip) const
+void AndTest::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_boolean && data[mRight].as_boolean;
+    frame[mTarget].as_boolean = frame[mLeft].as_boolean && frame[mRight].as_boolean;
+}
+
+void AndTest::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::AndTest, {mLeft, mRight, mTarget});
 }
 
 IntLTE::IntLTE(ObjectId left, ObjectId right, ObjectId target)
@@ -237,9 +409,21 @@ IntLTE::IntLTE(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IntLTE::toString() const { return "IntLTE left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IntLTE::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IntLTE::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_boolean = frame[mLeft].as_int <= frame[mRight].as_int;
+}
+
+void IntLTE::encode(bc::Assembler &assembler) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int <= data[mRight].as_int;
+    assembler.emit(bc::IntLTE, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> IntLTE::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
+{
+    if( mTarget != condition ) return nullptr;
+
+    return std::make_shared<JumpIfNotIntLTE>(mLeft, mRight, ipNew);
 }
 
 IsEqual::IsEqual(ObjectId left, ObjectId right, ObjectId target)
@@ -251,9 +435,21 @@ IsEqual::IsEqual(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IsEqual::toString() const { return "IsEqual left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IsEqual::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IsEqual::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int == data[mRight].as_int;
+    frame[mTarget].as_boolean = frame[mLeft].as_int == frame[mRight].as_int;
+}
+
+void IsEqual::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::IsEqual, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> IsEqual::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
+{
+    if( mTarget != condition ) return nullptr;
+
+    return std::make_shared<JumpIfNotIsEqual>(mLeft, mRight, ipNew);
 }
 
 IsNotEqual::IsNotEqual(ObjectId left, ObjectId right, ObjectId target)
@@ -265,9 +461,21 @@ IsNotEqual::IsNotEqual(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IsNotEqual::toString() const { return "IsNotEqual left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IsNotEqual::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IsNotEqual::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_boolean = frame[mLeft].as_int != frame[mRight].as_int;
+}
+
+void IsNotEqual::encode(bc::Assembler &assembler) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int != data[mRight].as_int;
+    assembler.emit(bc::IsNotEqual, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> IsNotEqual::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
+{
+    if( mTarget != condition ) return nullptr;
+
+    return std::make_shared<JumpIfNotIsNotEqual>(mLeft, mRight, ipNew);
 }
 
 IntGTE::IntGTE(ObjectId left, ObjectId right, ObjectId target)
@@ -279,9 +487,22 @@ IntGTE::IntGTE(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IntGTE::toString() const { return "IntGTE left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IntGTE::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IntGTE::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_boolean = frame[mLeft].as_int >= frame[mRight].as_int;
+}
+
+void IntGTE::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::IntGTE, {mLeft, mRight, mTarget});
+}
+
+std::shared_ptr<const Instruction> IntGTE::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int >= data[mRight].as_int;
+    if( mTarget != condition ) return nullptr;
+
+    // a >= b is the same as b <= a
+    return std::make_shared<JumpIfNotIntLTE>(mRight, mLeft, ipNew);
 }
 
 IntGreaterThan::IntGreaterThan(ObjectId left, ObjectId right, ObjectId target)
@@ -294,13 +515,27 @@ IntGreaterThan::IntGreaterThan(ObjectId left, ObjectId right, ObjectId target)
 
 std::string IntGreaterThan::toString() const { return "IntGreaterThan left=" +  std::to_string(mLeft) + " right=" + std::to_string(mRight) + " target=" + std::to_string(mTarget); }
 
-void IntGreaterThan::call(std::vector<Object> &data, InstructionPointer &ip) const
+void IntGreaterThan::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget].as_boolean = frame[mLeft].as_int > frame[mRight].as_int;
+}
+
+void IntGreaterThan::encode(bc::Assembler &assembler) const
 {
-    data[mTarget].as_boolean = data[mLeft].as_int > data[mRight].as_int;
+    assembler.emit(bc::IntGreaterThan, {mLeft, mRight, mTarget});
 }
 
-CollectGarbage::CollectGarbage(std::vector<ObjectId> keepObjects)
+std::shared_ptr<const Instruction> IntGreaterThan::fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const
+{
+    if( mTarget != condition ) return nullptr;
+
+    // a > b is the same as b < a
+    return std::make_shared<JumpIfNotIntLessThan>(mRight, mLeft, ipNew);
+}
+
+CollectGarbage::CollectGarbage(std::vector<ObjectId> keepObjects, std::vector<ObjectId> keepGlobals)
     :mKeepObjects(std::move(keepObjects))
+    ,mKeepGlobals(std::move(keepGlobals))
 {
 
 }
@@ -310,67 +545,175 @@ std::string CollectGarbage::toString() const
     std::stringstream ret;
     ret << "Free";
     for(auto id : mKeepObjects) ret << " " << id;
+    for(auto id : mKeepGlobals) ret << " global=" << id;
 
     return ret.str();
 }
 
-void CollectGarbage::call(std::vector<Object> &data, InstructionPointer &ip) const
+void CollectGarbage::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    std::set<ConstPtr> toBeKept;
+    auto & memory = frame.executor.memory();
+    memory.beginCollection();
     for(const auto id : mKeepObjects ) {
-        walk(data[id].as_ptr, toBeKept);
+        memory.mark(frame[id].as_ptr);
+    }
+    for(const auto id : mKeepGlobals ) {
+        memory.mark(frame.globals[id].as_ptr);
     }
 
-    memory().collectGarbage(toBeKept);
+    memory.collectGarbage();
 }
 
-void CollectGarbage::walk(ConstPtr ptr, std::set<ConstPtr> & toBeKept) const
+void CollectGarbage::encode(bc::Assembler &assembler) const
 {
-    if( toBeKept.count(ptr) ) return;
-    toBeKept.insert(ptr);
-    for(auto child : ptr->children()) {
-        walk(child, toBeKept);
+    std::vector<size_t> operands = {mKeepObjects.size()};
+    operands.insert(operands.end(), mKeepObjects.begin(), mKeepObjects.end());
+    operands.push_back(mKeepGlobals.size());
+    operands.insert(operands.end(), mKeepGlobals.begin(), mKeepGlobals.end());
+    assembler.emit(bc::CollectGarbage, operands);
+}
+
+
+Safepoint::Safepoint(bool always, std::vector<ObjectId> roots, std::vector<ObjectId> globals)
+    : mAlways(always)
+    , mRoots(std::move(roots))
+    , mGlobals(std::move(globals))
+{
+
+}
+
+std::string Safepoint::toString() const
+{
+    std::stringstream ret;
+    ret << ( mAlways ? "Free" : "Safepoint" );
+    for(auto id : mRoots) ret << " " << id;
+    for(auto id : mGlobals) ret << " global=" << id;
+
+    return ret.str();
+}
+
+void Safepoint::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    auto & memory = frame.executor.memory();
+    if( ! mAlways && ! memory.needsCollection() ) return;
+
+    memory.beginCollection();
+    for(const auto id : mRoots) {
+        memory.mark(frame[id].as_ptr);
+    }
+    for(const auto id : mGlobals) {
+        memory.mark(frame.globals[id].as_ptr);
     }
+    memory.collectGarbage();
 }
 
+void Safepoint::encode(bc::Assembler &assembler) const
+{
+    const auto roots = assembler.addRoots({
+        std::vector<bc::Word>(mRoots.begin(), mRoots.end()),
+        std::vector<bc::Word>(mGlobals.begin(), mGlobals.end())
+    });
+    assembler.emit(bc::Safepoint, {roots, mAlways});
+}
 
-void PrintInt::call(std::vector<Object> &data, InstructionPointer &ip) const
+std::shared_ptr<const Instruction> Safepoint::withRoots(std::vector<ObjectId> roots, std::vector<ObjectId> globals) const
 {
-    *(getOutput().stdout) << data[mSource].as_int << "\n";
+    return std::make_shared<Safepoint>(mAlways, std::move(roots), std::move(globals));
 }
 
 
-void PrintString::call(std::vector<Object> &data, InstructionPointer &ip) const
+
+void PrintInt::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    *(getOutput().stdout) << static_cast<obj::String*>(data[mSource].as_ptr)->value() << "\n";
+    frame.executor.output().printLine(frame[mSource].as_int);
+}
+
+void PrintInt::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::PrintInt, {mSource});
 }
 
 
-void ReadFromStdin::call(std::vector<Object> &data, InstructionPointer &ip) const
+void PrintString::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    auto * tuple = static_cast<obj::Tuple<2>*>(data[mTarget].as_ptr);
-    if(  std::cin.eof() ) {
-        tuple->data[0].as_int = 0; // TODO: explicit enum value
-    } else {
+    frame.executor.output().printLine(static_cast<obj::String*>(frame[mSource].as_ptr)->value());
+}
 
-        std::string value;
-        std::getline(std::cin, value);
+void PrintString::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::PrintString, {mSource});
+}
+
+
+void ReadFromStdin::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    read(static_cast<obj::Tuple<2>*>(frame[mTarget].as_ptr), frame.executor);
+}
+
+void ReadFromStdin::read(obj::Tuple<2> * tuple, Executor & executor)
+{
+    ReadLine::read(tuple->data[0], tuple->data[1], executor);
+    if( tuple->data[0].as_int ) executor.memory().writeBarrier(tuple);
+}
+
+void ReadFromStdin::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::ReadFromStdin, {mTarget});
+}
+
+void ReadFromStdin::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.storeAllocated(mTarget);
+}
+
+
+ReadLine::ReadLine(ObjectId tag, ObjectId value)
+    : mTag(tag)
+    , mValue(value)
+{
+}
+
+std::string ReadLine::toString() const { return "ReadLine tag=" + std::to_string(mTag) + " value=" + std::to_string(mValue); }
+
+void ReadLine::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    read(frame[mTag], frame[mValue], frame.executor);
+}
 
-        // FIXME: check for errors
-        tuple->data[0].as_int = 1;
-        auto ptr = std::make_unique<obj::String>(value);
-        tuple->data[1].as_ptr = memory().add(std::move(ptr));
+void ReadLine::read(Object &tag, Object &value, Executor &executor)
+{
+    std::string_view line;
+    if( ! executor.input().next(line) ) {
+        tag.as_int = 0; // TODO: explicit enum value
+    } else {
+        tag.as_int = 1;
+        value.as_ptr = executor.memory().make<obj::String>(std::string(line));
     }
 }
 
+void ReadLine::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::ReadLine, {mTag, mValue});
+}
+
+void ReadLine::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.allocate(mValue);
+}
+
 
 MemPush::MemPush() {}
 
 std::string MemPush::toString() const { return "MemPush"; }
 
-void MemPush::call(std::vector<Object> &data, InstructionPointer &ip) const
+void MemPush::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    memory().push();
+    frame.executor.memory().push();
+}
+
+void MemPush::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::MemPush);
 }
 
 
@@ -378,9 +721,41 @@ MemPop::MemPop() {}
 
 std::string MemPop::toString() const { return "MemPop"; }
 
-void MemPop::call(std::vector<Object> &data, InstructionPointer &ip) const
+void MemPop::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame.executor.memory().pop();
+}
+
+void MemPop::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::MemPop);
+}
+
+
+PopRegion::PopRegion(std::vector<ObjectId> keep)
+    : mKeep(std::move(keep))
+{
+}
+
+std::string PopRegion::toString() const
+{
+    std::stringstream ret;
+    ret << "PopRegion";
+    for(auto id : mKeep) ret << " " << id;
+
+    return ret.str();
+}
+
+void PopRegion::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    memory().pop();
+    frame.executor.memory().popRegion(mKeep.empty() ? nullptr : &frame[mKeep.front()].as_ptr);
+}
+
+void PopRegion::encode(bc::Assembler &assembler) const
+{
+    std::vector<size_t> operands = {mKeep.size()};
+    operands.insert(operands.end(), mKeep.begin(), mKeep.end());
+    assembler.emit(bc::PopRegion, operands);
 }
 
 GetListLength::GetListLength(ObjectId source, ObjectId target)
@@ -395,10 +770,15 @@ std::string GetListLength::toString() const
     return "GetListLength " + std::to_string(mSource) +  " " + std::to_string(mTarget);
 }
 
-void GetListLength::call(std::vector<Object> &data, InstructionPointer &ip) const
+void GetListLength::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    auto ptr = static_cast<obj::List*>(data[mSource].as_ptr);
-    data[mTarget].as_int = ptr->mItems.size(); // TODO: casting from size_t to signed int
+    auto ptr = static_cast<obj::List*>(frame[mSource].as_ptr);
+    frame[mTarget].as_int = ptr->mItems.size(); // TODO: casting from size_t to signed int
+}
+
+void GetListLength::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::GetListLength, {mSource, mTarget});
 }
 
 AppendToList::AppendToList(ObjectId list, ObjectId item)
@@ -413,18 +793,164 @@ std::string AppendToList::toString() const
     return "AppendToList " + std::to_string(mList) +  " " + std::to_string(mItem);
 }
 
-void AppendToList::call(std::vector<Object> &data, InstructionPointer &ip) const
+void AppendToList::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    auto ptr = static_cast<obj::List*>(frame[mList].as_ptr);
+    ptr->mItems.push_back(frame[mItem]);
+}
+
+void AppendToList::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::AppendToList, {mList, mItem});
+}
+
+void AppendToList::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.store(mList, mItem);
+}
+
+
+WriteBarrier::WriteBarrier(ObjectId object)
+    : mObject(object)
+{
+}
+
+std::string WriteBarrier::toString() const
+{
+    return "WriteBarrier " + std::to_string(mObject);
+}
+
+void WriteBarrier::call(Frame &frame, InstructionPointer & /* ip */) const
 {
-    auto ptr = static_cast<obj::List*>(data[mList].as_ptr);
-    ptr->mItems.push_back(data[mItem]);
+    frame.executor.memory().writeBarrier(frame[mObject].as_ptr);
 }
 
+void WriteBarrier::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::WriteBarrier, {mObject});
+}
 
 
+LoadGlobal::LoadGlobal(ObjectId global, ObjectId target)
+    : mGlobal(global)
+    , mTarget(target)
+{
+}
+
+std::string LoadGlobal::toString() const { return "LoadGlobal global=" + std::to_string(mGlobal) + " target=" + std::to_string(mTarget); }
 
+void LoadGlobal::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame[mTarget] = frame.globals[mGlobal];
+}
 
+void LoadGlobal::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::LoadGlobal, {mGlobal, mTarget});
+}
+
+void LoadGlobal::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.load(mTarget);
+}
+
+
+StoreGlobal::StoreGlobal(ObjectId source, ObjectId global)
+    : mSource(source)
+    , mGlobal(global)
+{
+}
+
+std::string StoreGlobal::toString() const { return "StoreGlobal source=" + std::to_string(mSource) + " global=" + std::to_string(mGlobal); }
+
+void StoreGlobal::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame.globals[mGlobal] = frame[mSource];
+}
+
+void StoreGlobal::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::StoreGlobal, {mSource, mGlobal});
+}
+
+void StoreGlobal::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    analysis.leak(mSource);
+}
 
 
+Call::Call(std::shared_ptr<const FunctionCode> function, std::vector<ObjectId> arguments, ObjectId target)
+    : mFunction(std::move(function))
+    , mArguments(std::move(arguments))
+    , mTarget(target)
+{
+}
+
+std::string Call::toString() const
+{
+    std::stringstream ret;
+    ret << "Call " << mFunction->name << "(";
+    for(size_t i = 0; i < mArguments.size(); i++) ret << (i ? " " : "") << mArguments[i];
+    ret << ") target=" << mTarget;
+
+    return ret.str();
+}
+
+void Call::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    std::vector<Object> objects(mFunction->numObjects);
+    mFunction->constants->initialize(objects);
+    for(size_t i = 0; i < mArguments.size(); i++) {
+        objects[i] = frame[mArguments[i]];
+    }
+
+    Frame callee {objects, frame.globals, frame.executor};
+    execute(*mFunction, callee);
+
+    frame[mTarget] = callee.returnValue;
+}
+
+void Call::encode(bc::Assembler &assembler) const
+{
+    assembler.emitCall(mFunction, mArguments, mTarget);
+}
+
+void Call::analyzeEscapes(EscapeAnalysis &analysis) const
+{
+    // The function may keep its arguments, and return one of them, a global or a new object
+    for(auto argument : mArguments) {
+        analysis.leak(argument);
+        analysis.copy(argument, mTarget);
+    }
+    if( mFunction->escapes ) analysis.escape();
+    analysis.allocate(mTarget);
+    analysis.load(mTarget);
+}
+
+std::shared_ptr<const Instruction> Call::retarget(ObjectId oldTarget, ObjectId newTarget) const
+{
+    if( mTarget != oldTarget ) return nullptr;
+
+    return std::make_shared<Call>(mFunction, mArguments, newTarget);
+}
+
+
+Return::Return(ObjectId source)
+    : mSource(source)
+{
+}
+
+std::string Return::toString() const { return "Return source=" + std::to_string(mSource); }
+
+void Return::call(Frame &frame, InstructionPointer & /* ip */) const
+{
+    frame.returnValue = frame[mSource];
+}
+
+void Return::encode(bc::Assembler &assembler) const
+{
+    assembler.emit(bc::Return, {mSource});
+}
 
 
 } // namespace ins
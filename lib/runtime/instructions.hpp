@@ -1,27 +1,62 @@
 ﻿#pragma once
 #include "common/object.hpp"
+#include "runtime/bytecode.hpp"
+#include "runtime/escapeanalysis.hpp"
 #include "runtime/objects/tuple.hpp"
+#include "tokenizer/tokenizer.hpp"
 
 #include <functional>
 #include <memory>
 #include <ostream>
-#include <set>
 #include <sstream>
+#include <string>
 #include <vector>
 
 
 namespace obj { class Function; }
+namespace bc { class Assembler; }
+class Executor;
 
 
 using InstructionPointer = size_t;
 
 
+/// Objects of one function invocation
+struct Frame
+{
+    std::vector<Object> & objects;
+    /// Objects of the main program, see LoadGlobal
+    std::vector<Object> & globals;
+    /// Owns heap and I/O
+    Executor & executor;
+    /// Set by Return
+    Object returnValue = {};
+
+    Object & operator[](ObjectId id) { return objects[id]; }
+};
+
+
 class Instruction
 {
 public:
     virtual std::string toString() const = 0;
     /// call() can be const because it does not alter internal state of instruction
-    virtual void call(std::vector<Object> & data, InstructionPointer & ip) const = 0;
+    virtual void call(Frame & frame, InstructionPointer & ip) const = 0;
+    /// Append bytecode equivalent of this instruction, see bc::Program
+    virtual void encode(bc::Assembler & assembler) const = 0;
+
+    /// Same instruction, but writing to newTarget instead of oldTarget.
+    /// nullptr if the instruction does not write to oldTarget or cannot be retargeted
+    virtual std::shared_ptr<const Instruction> retarget(ObjectId /* oldTarget */, ObjectId /* newTarget */) const { return nullptr; }
+
+    /// Superinstruction which evaluates this instruction and jumps to ipNew if condition is false.
+    /// nullptr if the instruction does not compute condition or cannot be fused
+    virtual std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId /* condition */, InstructionPointer /* ipNew */) const { return nullptr; }
+
+    /// Report to analysis how the instruction moves pointers between objects.
+    /// Instructions which only deal with numbers have nothing to report
+    virtual void analyzeEscapes(EscapeAnalysis & /* analysis */) const {}
+
     virtual ~Instruction() = default;
 };
 
@@ -29,16 +64,42 @@ public:
 using InstructionVector = std::vector<std::shared_ptr<const Instruction> >;
 
 
+/// Source position of the instructions from ip up to the next entry, see FunctionCode::positions
+struct SourcePosition
+{
+    InstructionPointer ip;
+    int line;
+    int column;
+};
+
+
+/// Compiled body of a user function, or of the main program.
+/// Every invocation gets its own objects, the first numArguments of which hold the arguments.
+struct FunctionCode
+{
+    std::string name;
+    InstructionVector instructions;
+    size_t numObjects = 0;
+    size_t numArguments = 0;
+    /// Literals of the function body
+    std::shared_ptr<const ConstantPool> constants;
+    /// Sorted by ip, one entry per statement
+    std::vector<SourcePosition> positions;
+    /// Objects allocated by an invocation may be reachable after it returns, other than through its return value
+    bool escapes = true;
+};
+
+
 namespace ins {
 
 
-// TODO: set literals only once
 class SetInt: public Instruction
 {
 public:
     SetInt(ObjectId target, int64_t value);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
 
     ~SetInt() override {}
 
@@ -53,7 +114,9 @@ class AddInt: public Instruction
 public:
     AddInt(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> retarget(ObjectId oldTarget, ObjectId newTarget) const override;
     ~AddInt() override {}
 
 private:
@@ -63,45 +126,51 @@ private:
 };
 
 
-class SetFloat: public Instruction
+/// Superinstruction for adding an integer literal
+class AddIntImmediate: public Instruction
 {
 public:
-    SetFloat(ObjectId target, double value);
+    AddIntImmediate(ObjectId left, int64_t value, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
-    ~SetFloat() override {}
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> retarget(ObjectId oldTarget, ObjectId newTarget) const override;
+    ~AddIntImmediate() override {}
 
 private:
+    const ObjectId mLeft;
+    const int64_t mValue;
     const ObjectId mTarget;
-    const double mValue;
 };
 
 
-class SetBoolean: public Instruction
+class SetFloat: public Instruction
 {
 public:
-    SetBoolean(ObjectId target, bool value);
+    SetFloat(ObjectId target, double value);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
-    ~SetBoolean() override {}
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    ~SetFloat() override {}
 
 private:
     const ObjectId mTarget;
-    const bool mValue;
+    const double mValue;
 };
 
 
-class SetString: public Instruction
+class SetBoolean: public Instruction
 {
 public:
-    SetString(ObjectId target, const std::string & value);
+    SetBoolean(ObjectId target, bool value);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
-    ~SetString() override {}
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    ~SetBoolean() override {}
 
 private:
     const ObjectId mTarget;
-    const std::string mValue;
+    const bool mValue;
 };
 
 
@@ -116,12 +185,14 @@ public:
 
     }
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
     ~SetAllocated() override;
 
 private:
     const ObjectId mTarget;
-    std::function<std::unique_ptr<obj::Allocated>()> mCreator;
+    bc::Creator mCreator;
 };
 
 
@@ -130,7 +201,8 @@ class IntGte: public Instruction
 public:
     IntGte(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~IntGte() override {}
 
 private:
@@ -146,7 +218,8 @@ class JumpIf: public Instruction
 public:
     JumpIf(ObjectId condition, InstructionPointer ipNew);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~JumpIf() override {}
 
 private:
@@ -160,7 +233,8 @@ class JumpIfNot: public Instruction
 public:
     JumpIfNot(ObjectId condition, InstructionPointer ipNew);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~JumpIfNot() override {}
 
 private:
@@ -174,7 +248,8 @@ class Jump: public Instruction
 public:
     Jump(InstructionPointer ipNew);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~Jump() override {}
 
 private:
@@ -182,12 +257,95 @@ private:
 };
 
 
+/// Superinstruction for comparing two integers and jumping if the comparison is false
+template<typename Compare, bc::Opcode Opcode>
+class IntCompareJumpIfNot: public Instruction
+{
+public:
+    IntCompareJumpIfNot(ObjectId left, ObjectId right, InstructionPointer ipNew)
+        : mLeft(left)
+        , mRight(right)
+        , mIpNew(ipNew)
+    {
+
+    }
+
+    std::string toString() const override
+    {
+        std::stringstream stream;
+        stream << bc::info(Opcode).name << " left=" << mLeft << " right=" << mRight << " ip=" << mIpNew;
+
+        return stream.str();
+    }
+
+    void call(Frame & frame, InstructionPointer & ip) const override
+    {
+        if( ! Compare()(frame[mLeft].as_int, frame[mRight].as_int) ) ip = mIpNew - 1;
+    }
+
+    void encode(bc::Assembler & assembler) const override
+    {
+        assembler.emit(Opcode, {mLeft, mRight, mIpNew});
+    }
+
+private:
+    const ObjectId mLeft;
+    const ObjectId mRight;
+    const InstructionPointer mIpNew;
+};
+
+
+using JumpIfNotIntLessThan = IntCompareJumpIfNot<std::less<int64_t>, bc::JumpIfNotIntLessThan>;
+using JumpIfNotIntLTE = IntCompareJumpIfNot<std::less_equal<int64_t>, bc::JumpIfNotIntLTE>;
+using JumpIfNotIsEqual = IntCompareJumpIfNot<std::equal_to<int64_t>, bc::JumpIfNotIsEqual>;
+using JumpIfNotIsNotEqual = IntCompareJumpIfNot<std::not_equal_to<int64_t>, bc::JumpIfNotIsNotEqual>;
+
+
+/// Superinstruction for the end of a counting loop: adds step to counter, and jumps back
+/// to the start of the loop body as long as the result is less than end. Expects counter
+/// to be less than end and step to be positive, and never overflows
+class AddIntJumpIfLessThan: public Instruction
+{
+public:
+    AddIntJumpIfLessThan(ObjectId counter, ObjectId step, ObjectId end, ObjectId target, InstructionPointer ipNew);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    ~AddIntJumpIfLessThan() override {}
+
+private:
+    const ObjectId mCounter;
+    const ObjectId mStep;
+    const ObjectId mEnd;
+    const ObjectId mTarget;
+    const InstructionPointer mIpNew;
+};
+
+
+/// Throws InvalidStep unless step is positive, see AddIntJumpIfLessThan
+class CheckStep: public Instruction
+{
+public:
+    CheckStep(ObjectId step, Position position);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    ~CheckStep() override {}
+
+private:
+    const ObjectId mStep;
+    const Position mPosition;
+};
+
+
 class Copy: public Instruction
 {
 public:
     Copy(ObjectId source, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
     ~Copy() override {}
 
 private:
@@ -201,7 +359,9 @@ class IntLessThan: public Instruction
 public:
     IntLessThan(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IntLessThan() override {}
 
 private:
@@ -216,7 +376,9 @@ class IntLTE: public Instruction
 public:
     IntLTE(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IntLTE() override {}
 
 private:
@@ -231,7 +393,9 @@ class IsEqual: public Instruction
 public:
     IsEqual(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IsEqual() override {}
 
 private:
@@ -246,7 +410,9 @@ class IsNotEqual: public Instruction
 public:
     IsNotEqual(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IsNotEqual() override {}
 
 private:
@@ -261,7 +427,9 @@ class IntGTE: public Instruction
 public:
     IntGTE(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IntGTE() override {}
 
 private:
@@ -276,7 +444,9 @@ class IntGreaterThan: public Instruction
 public:
     IntGreaterThan(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    std::shared_ptr<const Instruction> fuseJumpIfNot(ObjectId condition, InstructionPointer ipNew) const override;
     ~IntGreaterThan() override {}
 
 private:
@@ -292,7 +462,8 @@ class OrTest: public Instruction
 public:
     OrTest(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~OrTest() override {}
 
 private:
@@ -307,7 +478,8 @@ class AndTest: public Instruction
 public:
     AndTest(ObjectId left, ObjectId right, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~AndTest() override {}
 
 private:
@@ -322,7 +494,8 @@ class Negate: public Instruction
 public:
     Negate(ObjectId source, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~Negate() override {}
 
 private:
@@ -336,7 +509,8 @@ class Noop: public Instruction
 public:
     Noop();
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~Noop() override {}
 };
 
@@ -344,18 +518,41 @@ public:
 class CollectGarbage: public Instruction
 {
 public:
-    CollectGarbage(std::vector<ObjectId> keepObjects);
+    CollectGarbage(std::vector<ObjectId> keepObjects, std::vector<ObjectId> keepGlobals = {});
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~CollectGarbage() override {}
 
 private:
 
-    using ConstPtr = const obj::Allocated *;
+    const std::vector<ObjectId> mKeepObjects;
+    const std::vector<ObjectId> mKeepGlobals;
+};
 
-    void walk(ConstPtr ptr, std::set<ConstPtr> & toBeKept) const;
 
-    const std::vector<ObjectId> mKeepObjects;
+/// Collect garbage if the heap has grown enough since the last collection, see MemoryManager::needsCollection.
+/// Inserted by the compiler at loop back-edges and function returns. The roots are all allocated objects
+/// of the function, bytecode only keeps those which are live at the safepoint, see bc::allocateSlots
+class Safepoint: public Instruction
+{
+public:
+    /// Collect regardless of the growth of the heap if always is set, as free does
+    explicit Safepoint(bool always = false, std::vector<ObjectId> roots = {}, std::vector<ObjectId> globals = {});
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+
+    /// Same safepoint with the given roots. The compiler knows them once the function is complete
+    std::shared_ptr<const Instruction> withRoots(std::vector<ObjectId> roots, std::vector<ObjectId> globals) const;
+
+    ~Safepoint() override {}
+
+private:
+
+    const bool mAlways;
+    const std::vector<ObjectId> mRoots;
+    const std::vector<ObjectId> mGlobals;
 };
 
 
@@ -377,10 +574,19 @@ public:
 
         return stream.str();
     }
-    void call(std::vector<Object> & data, InstructionPointer &) const override
+    void call(Frame & frame, InstructionPointer &) const override
     {
-        auto tuple = static_cast<obj::Tuple<TupleSize> *>(data[mTuple].as_ptr);
-        data[mTarget] = std::get<Index>(tuple->data);
+        auto tuple = static_cast<obj::Tuple<TupleSize> *>(frame[mTuple].as_ptr);
+        frame[mTarget] = std::get<Index>(tuple->data);
+    }
+    void encode(bc::Assembler & assembler) const override
+    {
+        static_assert(TupleSize == 2, "Bytecode only supports pairs so far");
+        assembler.emit(bc::ReadFromTuple, {mTuple, Index, mTarget});
+    }
+    void analyzeEscapes(EscapeAnalysis & analysis) const override
+    {
+        analysis.read(mTuple, mTarget);
     }
 
 private:
@@ -389,6 +595,7 @@ private:
 };
 
 
+/// Storing a pointer must be followed by WriteBarrier
 template<int Index, int TupleSize>
 class WriteToTuple: public Instruction
 {
@@ -404,20 +611,30 @@ public:
     std::string toString() const override
     {
         std::stringstream stream;
-        stream << "WriteToTuple " << mTuple << " " << mIndex << " " <<  mSource;
+        stream << "WriteToTuple " << mTuple << " " << Index << " " <<  mSource;
 
         return stream.str();
     }
 
-    void call(std::vector<Object> & data, InstructionPointer &) const override
+    void call(Frame & frame, InstructionPointer &) const override
+    {
+        auto tuple = static_cast<obj::Tuple<TupleSize> *>(frame[mTuple].as_ptr);
+        std::get<Index>(tuple->data) = frame[mSource];
+    }
+
+    void encode(bc::Assembler & assembler) const override
     {
-        auto tuple = static_cast<obj::Tuple<TupleSize> *>(data[mTuple].as_ptr);
-        std::get<Index>(tuple->data[mIndex]) = data[mSource];
+        static_assert(TupleSize == 2, "Bytecode only supports pairs so far");
+        assembler.emit(bc::WriteToTuple, {mTuple, Index, mSource});
+    }
+
+    void analyzeEscapes(EscapeAnalysis & analysis) const override
+    {
+        analysis.store(mTuple, mSource);
     }
 
 private:
     const ObjectId mTuple;
-    const size_t mIndex;
     const ObjectId mSource;
 };
 
@@ -430,7 +647,8 @@ public:
 
     std::string toString() const override { return "PrintInt " +  std::to_string(mSource); }
 
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
 
 
 private:
@@ -446,7 +664,8 @@ public:
 
     std::string toString() const override { return "PrintString " +  std::to_string(mSource); }
 
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
 
 
 private:
@@ -463,7 +682,12 @@ public:
 
     std::string toString() const override { return "ReadFromStdin " +  std::to_string(mTarget); }
 
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
+
+    /// Read next line from input of executor into optional
+    static void read(obj::Tuple<2> * optional, Executor & executor);
 
 
 private:
@@ -471,13 +695,34 @@ private:
 };
 
 
+/// Same as ReadFromStdin, but with the tag and the value of the optional in objects of their own,
+/// s.t. loops over the input do not allocate a tuple per line, see ct::Function::generateUnboxedOptional
+class ReadLine: public Instruction
+{
+public:
+    ReadLine(ObjectId tag, ObjectId value);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
+
+    /// Read next line from input of executor into value and set tag to 1, or only set tag to 0 at the end of the input
+    static void read(Object & tag, Object & value, Executor & executor);
+
+private:
+    const ObjectId mTag;
+    const ObjectId mValue;
+};
+
+
 /// Create a barrier in garbage collector s.t. user functions can call free
 class MemPush: public Instruction
 {
 public:
     MemPush();
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~MemPush() override {}
 };
 
@@ -488,17 +733,36 @@ class MemPop: public Instruction
 public:
     MemPop();
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
     ~MemPop() override {}
 };
 
 
+/// Remove the latest barrier and delete every object allocated since, except those reachable from keep.
+/// Replaces MemPop in functions whose objects cannot be reached from outside, see EscapeAnalysis
+class PopRegion: public Instruction
+{
+public:
+    /// keep holds the return value if it is allocated, otherwise it is empty
+    explicit PopRegion(std::vector<ObjectId> keep);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    ~PopRegion() override {}
+
+private:
+    const std::vector<ObjectId> mKeep;
+};
+
+
 class GetListLength: public Instruction
 {
 public:
     GetListLength(ObjectId source, ObjectId target);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
 
 private:
     const ObjectId mSource;
@@ -506,12 +770,15 @@ private:
 };
 
 
+/// Appending a pointer must be followed by WriteBarrier
 class AppendToList: public Instruction
 {
 public:
     AppendToList(ObjectId list, ObjectId item);
     std::string toString() const override;
-    void call(std::vector<Object> & data, InstructionPointer & ip) const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
 
 private:
     const ObjectId mList;
@@ -519,5 +786,83 @@ private:
 };
 
 
+/// Let the memory manager know that a pointer has been stored into object, see MemoryManager::writeBarrier.
+/// Emitted by the compiler after stores of allocated values only, storing numbers needs no barrier
+class WriteBarrier: public Instruction
+{
+public:
+    explicit WriteBarrier(ObjectId object);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+
+private:
+    const ObjectId mObject;
+};
+
+
+/// Read an object of the main program from within a function
+class LoadGlobal: public Instruction
+{
+public:
+    LoadGlobal(ObjectId global, ObjectId target);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
+
+private:
+    const ObjectId mGlobal;
+    const ObjectId mTarget;
+};
+
+
+/// Write an object of the main program from within a function
+class StoreGlobal: public Instruction
+{
+public:
+    StoreGlobal(ObjectId source, ObjectId global);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
+
+private:
+    const ObjectId mSource;
+    const ObjectId mGlobal;
+};
+
+
+/// Execute function in a new frame and write its return value to target
+class Call: public Instruction
+{
+public:
+    Call(std::shared_ptr<const FunctionCode> function, std::vector<ObjectId> arguments, ObjectId target);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+    void analyzeEscapes(EscapeAnalysis & analysis) const override;
+    std::shared_ptr<const Instruction> retarget(ObjectId oldTarget, ObjectId newTarget) const override;
+
+private:
+    const std::shared_ptr<const FunctionCode> mFunction;
+    const std::vector<ObjectId> mArguments;
+    const ObjectId mTarget;
+};
+
+
+/// Leave the function, must be its last instruction
+class Return: public Instruction
+{
+public:
+    Return(ObjectId source);
+    std::string toString() const override;
+    void call(Frame & frame, InstructionPointer & ip) const override;
+    void encode(bc::Assembler & assembler) const override;
+
+private:
+    const ObjectId mSource;
+};
+
 
 } // namespace ins
@@ -0,0 +1,238 @@
+#include "linereader.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GECKO_POSIX_INPUT 1
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#else
+    #define GECKO_POSIX_INPUT 0
+#endif
+
+
+namespace {
+
+    /// Bytes read at once, the buffer grows beyond for longer lines
+    constexpr size_t blockSize = 64 * 1024;
+
+    /// A batch read ahead ends after the line which makes it reach this many bytes, or this many lines
+    constexpr size_t batchSize = 64 * 1024;
+    constexpr size_t batchLines = 4096;
+
+}
+
+
+LineReader::LineReader(std::istream &input)
+{
+    reset(input);
+}
+
+LineReader::~LineReader()
+{
+    stopReadAhead();
+    unmap();
+}
+
+void LineReader::reset(std::istream &input)
+{
+    stopReadAhead();
+    unmap();
+    mInput = &input;
+    mDescriptor = -1;
+    mBegin = mEnd = mScanned = 0;
+    mEndOfInput = mDone = false;
+
+#if GECKO_POSIX_INPUT
+    if( &input != &std::cin ) return;
+
+    mDescriptor = STDIN_FILENO;
+    struct stat status;
+    if( fstat(mDescriptor, &status) != 0 || ! S_ISREG(status.st_mode) ) return;
+
+    const auto offset = lseek(mDescriptor, 0, SEEK_CUR);
+    if( offset < 0 || offset >= status.st_size ) return;
+
+    const auto size = static_cast<size_t>(status.st_size);
+    const auto mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, mDescriptor, 0);
+    if( mapped == MAP_FAILED ) return;
+
+    madvise(mapped, size, MADV_SEQUENTIAL);
+    mMapped = static_cast<const char *>(mapped);
+    mMappedSize = size;
+    mBegin = static_cast<size_t>(offset);
+    mEnd = size;
+    mEndOfInput = true;
+#endif
+}
+
+void LineReader::unmap()
+{
+#if GECKO_POSIX_INPUT
+    if( mMapped ) munmap(const_cast<char *>(mMapped), mMappedSize);
+#endif
+    mMapped = nullptr;
+    mMappedSize = 0;
+}
+
+void LineReader::setReadAhead(size_t numBatches)
+{
+    stopReadAhead();
+    mNumBatches = numBatches;
+}
+
+bool LineReader::next(std::string_view &line)
+{
+    if( mNumBatches == 0 ) return split(line);
+
+    if( mBatchLine == mBatch.lines.size() ) {
+        if( mBatch.last ) return false;
+
+        std::unique_lock<std::mutex> lock(mMutex);
+        if( ! mThread.joinable() ) mThread = std::thread(&LineReader::readAhead, this);
+
+        // The view handed out last points into mBatch, which can be reused from now on
+        mFree.push_back(std::move(mBatch));
+        mFreeChanged.notify_one();
+        mReadyChanged.wait(lock, [this] { return ! mReady.empty(); });
+        mBatch = std::move(mReady.front());
+        mReady.pop_front();
+        mBatchLine = 0;
+
+        if( mBatch.error ) std::rethrow_exception(mBatch.error);
+        if( mBatch.lines.empty() ) return false;
+    }
+
+    const auto & [offset, size] = mBatch.lines[mBatchLine++];
+    line = std::string_view(mBatch.text.data() + offset, size);
+
+    return true;
+}
+
+void LineReader::readAhead()
+{
+    for(;;) {
+        Batch batch;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mFreeChanged.wait(lock, [this] { return mStopping || mReady.size() < mNumBatches; });
+            if( mStopping ) return;
+
+            if( ! mFree.empty() ) {
+                batch = std::move(mFree.back());
+                mFree.pop_back();
+            }
+        }
+
+        batch.text.clear();
+        batch.lines.clear();
+        try {
+            std::string_view line;
+            while( batch.text.size() < batchSize && batch.lines.size() < batchLines ) {
+                if( ! split(line) ) {
+                    batch.last = true;
+                    break;
+                }
+                batch.lines.emplace_back(batch.text.size(), line.size());
+                batch.text.insert(batch.text.end(), line.begin(), line.end());
+            }
+        } catch(...) {
+            batch.error = std::current_exception();
+            batch.last = true;
+        }
+
+        const auto last = batch.last;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mReady.push_back(std::move(batch));
+        }
+        mReadyChanged.notify_one();
+        if( last ) return;
+    }
+}
+
+void LineReader::stopReadAhead()
+{
+    if( mThread.joinable() ) {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mFreeChanged.notify_one();
+        mThread.join();
+    }
+
+    mStopping = false;
+    mReady.clear();
+    mFree.clear();
+    mBatch = {};
+    mBatchLine = 0;
+}
+
+bool LineReader::split(std::string_view &line)
+{
+    if( mDone ) return false;
+
+    for(;;) {
+        const auto data = mMapped ? mMapped : mBuffer.data();
+        const auto begin = data + mBegin;
+        const auto size = mEnd - mBegin;
+
+        const auto newline = static_cast<const char *>(std::memchr(begin + mScanned, '\n', size - mScanned));
+        if( newline ) {
+            line = std::string_view(begin, newline - begin);
+            mBegin += line.size() + 1;
+            mScanned = 0;
+
+            return true;
+        }
+
+        if( mEndOfInput ) {
+            line = std::string_view(begin, size);
+            mBegin = mEnd;
+            mDone = true;
+
+            return true;
+        }
+
+        mScanned = size;
+        fill();
+    }
+}
+
+void LineReader::fill()
+{
+    // Keep the line which is not complete yet
+    const auto remaining = mEnd - mBegin;
+    std::memmove(mBuffer.data(), mBuffer.data() + mBegin, remaining);
+    mBegin = 0;
+    mEnd = remaining;
+    if( mBuffer.size() < mEnd + blockSize ) mBuffer.resize(std::max(2 * mBuffer.size(), mEnd + blockSize));
+
+    const auto space = mBuffer.size() - mEnd;
+    size_t numRead = 0;
+#if GECKO_POSIX_INPUT
+    if( mDescriptor >= 0 ) {
+        ssize_t result;
+        do {
+            result = read(mDescriptor, mBuffer.data() + mEnd, space);
+        } while( result < 0 && errno == EINTR );
+
+        if( result < 0 ) throw std::system_error(errno, std::generic_category(), "Cannot read input");
+        numRead = static_cast<size_t>(result);
+    } else
+#endif
+    {
+        mInput->read(mBuffer.data() + mEnd, static_cast<std::streamsize>(space));
+        numRead = static_cast<size_t>(mInput->gcount());
+        if( mInput->bad() ) throw std::system_error(std::make_error_code(std::io_errc::stream), "Cannot read input");
+    }
+
+    mEnd += numRead;
+    mEndOfInput = numRead == 0;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/// Splits an input stream into lines, see next.
+///
+/// Input is read in large blocks and scanned for newlines with memchr, instead of character by character
+/// as std::getline does. Lines are handed out as views into the block, s.t. they are only copied once,
+/// into the string objects of the program. On std::cin, the file descriptor is read directly, bypassing
+/// the synchronisation of iostreams with stdio, and regular files are mapped into memory as a whole.
+///
+/// Optionally, a thread of its own reads and splits the input ahead of the program, see setReadAhead
+class LineReader
+{
+public:
+
+    explicit LineReader(std::istream & input);
+    ~LineReader();
+
+    LineReader(const LineReader &) = delete;
+    LineReader & operator=(const LineReader &) = delete;
+
+    /// Read from input from now on, forgetting whatever is left of the previous input
+    void reset(std::istream & input);
+
+    /// Read up to numBatches batches of lines ahead on a separate thread, s.t. waiting for input overlaps with
+    /// executing the program. Worth it for pipes and slow file systems. The thread starts with the first call
+    /// of next, and destroying or resetting the reader waits for a read in progress. Zero, the default, reads
+    /// on the calling thread. Call before reading any line
+    void setReadAhead(size_t numBatches);
+
+    /// Next line without its newline, valid until the next call. False once every line has been read.
+    /// As with std::getline, input which ends with a newline is followed by an empty line
+    bool next(std::string_view & line);
+
+private:
+
+    /// Lines split by the thread reading ahead
+    struct Batch
+    {
+        std::vector<char> text;
+        /// Offset into text and length of every line
+        std::vector<std::pair<size_t, size_t> > lines;
+        /// No batches follow this one
+        bool last = false;
+        /// Thrown by the thread reading ahead, rethrown by next
+        std::exception_ptr error;
+    };
+
+    /// Same as next, but always on the calling thread
+    bool split(std::string_view & line);
+
+    /// Loop of the thread reading ahead
+    void readAhead();
+
+    /// Wait for the thread reading ahead to end, and drop the batches it has read
+    void stopReadAhead();
+
+    /// Read another block after the lines which have been handed out. Sets mEndOfInput when nothing is left
+    void fill();
+
+    void unmap();
+
+    std::istream * mInput;
+
+    /// Descriptor read instead of mInput, -1 if there is none
+    int mDescriptor = -1;
+
+    std::vector<char> mBuffer;
+
+    /// Whole input if it has been mapped into memory, nullptr otherwise
+    const char * mMapped = nullptr;
+    size_t mMappedSize = 0;
+
+    /// Start of the lines not yet handed out, within mBuffer or mMapped
+    size_t mBegin = 0;
+    /// End of the data read so far
+    size_t mEnd = 0;
+    /// Bytes after mBegin known to hold no newline
+    size_t mScanned = 0;
+
+    bool mEndOfInput = false;
+    bool mDone = false;
+
+    size_t mNumBatches = 0;
+    std::thread mThread;
+    std::mutex mMutex;
+    /// Signalled when a batch is ready
+    std::condition_variable mReadyChanged;
+    /// Signalled when a batch has been consumed, or the thread should stop
+    std::condition_variable mFreeChanged;
+    std::deque<Batch> mReady;
+    /// Consumed batches, whose storage is reused
+    std::vector<Batch> mFree;
+    bool mStopping = false;
+
+    /// Batch which next hands out lines of
+    Batch mBatch;
+    size_t mBatchLine = 0;
+};
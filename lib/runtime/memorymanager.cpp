@@ -1,24 +1,161 @@
 #include "memorymanager.hpp"
+#include "objects/list.hpp"
+#include "workerpool.hpp"
 
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
 
-MemoryManager &memory()
+
+namespace {
+
+    /// Left in the nursery by MemoryManager::evacuate
+    struct Forwarded: obj::Allocated
+    {
+        Forwarded(obj::TypeIndex type, obj::Allocated * to)
+            : Allocated(type)
+            , to(to)
+        {
+        }
+
+        obj::Allocated * const to;
+    };
+
+    static_assert(sizeof(Forwarded) <= Arena::granularity, "Forwarding pointer must fit into the smallest slot");
+
+    /// Collecting the arena is not worth it below this many objects
+    constexpr size_t minFullThreshold = 1024;
+
+    /// Waking the workers of a MemoryManager is not worth it below this many objects in the arena
+    constexpr size_t minParallelObjects = 64 * 1024;
+
+    /// Marking threads only give away work from stacks of at least this many objects
+    constexpr size_t minShare = 64;
+
+    size_t slotSize(uint8_t sizeClass)
+    {
+        return ( sizeClass + 1 ) * Arena::granularity;
+    }
+
+    /// Counts the work done by one slice of an incremental collection
+    class Slice
+    {
+    public:
+        explicit Slice(const MemoryManager::SliceBudget & budget)
+            : mBudget(budget)
+            , mDeadline(std::chrono::steady_clock::now() + budget.time)
+        {
+        }
+
+        /// Whether the budget allows for one more object
+        bool next()
+        {
+            if( mBudget.objects && mDone >= mBudget.objects ) return false;
+
+            // Reading the clock costs more than marking a small object
+            if( mBudget.time.count() && mDone % 64 == 0 && std::chrono::steady_clock::now() >= mDeadline ) return false;
+
+            mDone++;
+
+            return true;
+        }
+
+    private:
+        const MemoryManager::SliceBudget mBudget;
+        const std::chrono::steady_clock::time_point mDeadline;
+        size_t mDone = 0;
+    };
+
+}
+
+
+class MemoryManager::MarkQueue
 {
-    static MemoryManager memoryManager;
+public:
 
-    return memoryManager;
+    explicit MarkQueue(size_t numWorkers)
+        : mNumWorkers(numWorkers)
+    {
+    }
+
+    /// Make work available before the workers start
+    void add(std::vector<obj::Allocated *> batch)
+    {
+        mBatches.push_back(std::move(batch));
+    }
+
+    /// Hand half of stack to workers which ran out of work, if there are any
+    void share(std::vector<obj::Allocated *> & stack)
+    {
+        if( stack.size() < minShare || mNumIdle.load(std::memory_order_relaxed) == 0 ) return;
+
+        const auto half = stack.begin() + stack.size() / 2;
+        std::vector<obj::Allocated *> batch(half, stack.end());
+        stack.erase(half, stack.end());
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mBatches.push_back(std::move(batch));
+        }
+        mAvailable.notify_one();
+    }
+
+    /// Wait for work and move it to stack. False once every worker waits, i.e. all reachable objects are marked
+    bool take(std::vector<obj::Allocated *> & stack)
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNumIdle++;
+        mAvailable.wait(lock, [this] { return ! mBatches.empty() || mNumIdle == mNumWorkers; });
+        if( mBatches.empty() ) {
+            mAvailable.notify_all();
+
+            return false;
+        }
+        mNumIdle--;
+        stack = std::move(mBatches.back());
+        mBatches.pop_back();
+
+        return true;
+    }
+
+private:
+    const size_t mNumWorkers;
+    std::mutex mMutex;
+    std::condition_variable mAvailable;
+    std::vector<std::vector<obj::Allocated *> > mBatches;
+    /// Only changed under mMutex, atomic s.t. share can peek without locking
+    std::atomic<size_t> mNumIdle {0};
+};
+
+
+MemoryManager::MemoryManager(size_t nurserySize)
+    : mNurserySize(nurserySize)
+    , mNursery(new char[nurserySize])
+    , mNurseryTop(mNursery.get())
+    , mNurseryEnd(mNursery.get() + nurserySize)
+    , mFullThreshold(minFullThreshold)
+{
+    mBarriers.push_back({0, mNurseryTop, mAllocatedBytes});
 }
 
-obj::Allocated *MemoryManager::add(std::unique_ptr<obj::Allocated> ptr)
+MemoryManager::~MemoryManager()
 {
-    const auto ret = ptr.get();
-    mAllocatedObjects.push_back(std::move(ptr));
+    clear();
+}
 
-    return ret;
+void MemoryManager::setCollectorThreads(size_t numThreads)
+{
+    mWorkers = ( numThreads > 1 ) ? std::make_unique<WorkerPool>(numThreads) : nullptr;
+}
+
+bool MemoryManager::isParallel() const
+{
+    return mWorkers && mAllocatedObjects.size() >= minParallelObjects;
 }
 
 void MemoryManager::push()
 {
-    mBarriers.push_back(mAllocatedObjects.size());
+    mBarriers.push_back({mAllocatedObjects.size(), mNurseryTop, mAllocatedBytes});
 }
 
 void MemoryManager::pop()
@@ -30,25 +167,572 @@ void MemoryManager::pop()
     mBarriers.pop_back();
 }
 
-void MemoryManager::collectGarbage(const std::set<const obj::Allocated *> &toBeKept)
+void MemoryManager::popRegion(obj::Allocated **result)
+{
+    if( mBarriers.size() < 2 ) {
+
+        throw CompilerBug { "MemoryManager::popRegion() called too many times" };
+    }
+
+    // An incremental collection may hold objects of the region in mGray or its range to sweep
+    if( mPhase != Phase::Idle ) {
+        pop();
+
+        return;
+    }
+
+    const auto barrier = mBarriers.back();
+    const auto numRegion = mAllocatedObjects.size();
+    for(auto i = barrier.old; i < numRegion; i++) mAllocatedObjects[i]->mFlags |= obj::Allocated::REGION;
+
+    // Young survivors move to the arena, s.t. the nursery can be reset to the barrier
+    const auto keep = [&](obj::Allocated *& slot) {
+        const auto object = slot;
+        if( ! object || isImmortal(object) ) return;
+
+        if( isYoung(object) ) {
+            if( reinterpret_cast<char *>(object) < barrier.young ) return;
+
+            slot = ( object->mFlags & obj::Allocated::FORWARDED )
+                 ? static_cast<Forwarded *>(object)->to
+                 : evacuate(object);
+        } else if( object->mFlags & obj::Allocated::REGION ) {
+            object->mFlags &= ~obj::Allocated::REGION;
+            mMarkStack.push_back(object);
+        }
+    };
+    if( result ) keep(*result);
+    while( ! mMarkStack.empty() ) {
+        const auto object = mMarkStack.back();
+        mMarkStack.pop_back();
+        forEachPointer(object, keep);
+    }
+
+    size_t kept = barrier.old;
+    for(size_t i = barrier.old; i < mAllocatedObjects.size(); i++) {
+        const auto object = mAllocatedObjects[i];
+        if( i < numRegion && ( object->mFlags & obj::Allocated::REGION ) ) {
+            object->mFlags &= ~obj::Allocated::REGION;
+            if( object->mFlags & obj::Allocated::REMEMBERED ) {
+                object->mFlags &= ~obj::Allocated::REMEMBERED;
+                mDeadRemembered.push_back(object);
+            } else {
+                destroy(object);
+            }
+        } else {
+            mAllocatedObjects[kept++] = object;
+        }
+    }
+    mAllocatedObjects.resize(kept);
+    destroyDeadRemembered();
+
+    forEachYoung(barrier.young, mNurseryTop, [&](obj::Allocated * object) {
+        if( ! ( object->mFlags & obj::Allocated::FORWARDED ) ) destroy(object);
+    });
+    mNurseryTop = barrier.young;
+
+    mBarriers.pop_back();
+}
+
+void MemoryManager::beginCollection(Collection collection)
+{
+    if( mStatistics ) {
+        mCollectionStart = std::chrono::steady_clock::now();
+        mFreedBytesAtStart = mFreedBytes;
+    }
+
+    const auto due = mAllocatedObjects.size() >= mFullThreshold;
+
+    // Roots outside the current frame are unknown elsewhere, objects they refer to must stay in place
+    mRootSlots.clear();
+    mCompactAlways = collection == Collection::Compact;
+    mCompact = ( mCompactAlways || mCompaction ) && mBarriers.size() == 1;
+
+    if( collection != Collection::Automatic || mSliceBudget.unlimited() ) {
+        finishIncremental();
+        mFull = collection != Collection::Automatic || due;
+        mCompact = mCompact && mFull;
+        if( mFull ) nextEpoch();
+
+        return;
+    }
+
+    // Marks of the previous collections stay valid until the incremental collection is complete
+    mFull = false;
+    mCompact = false;
+    if( mPhase == Phase::Idle && due ) {
+        nextEpoch();
+        mPhase = Phase::Marking;
+    }
+}
+
+void MemoryManager::nextEpoch()
+{
+    mEpoch++;
+    if( mEpoch == 0 ) {
+        // Wrapped around, marks of old collections could be mistaken for current ones
+        for(auto object : mAllocatedObjects) object->mMark.store(0, std::memory_order_relaxed);
+        mEpoch = 1;
+    }
+}
+
+void MemoryManager::mark(obj::Allocated *&root)
+{
+    if( mCompact ) mRootSlots.push_back(&root);
+    visit(root);
+    drainMarkStack();
+}
+
+void MemoryManager::visit(obj::Allocated *&slot)
+{
+    const auto object = slot;
+    if( ! object || isImmortal(object) ) return;
+
+    if( isYoung(object) ) {
+        // Young objects before the barrier stay, see collectGarbage
+        if( reinterpret_cast<char *>(object) < mBarriers.back().young ) return;
+
+        slot = ( object->mFlags & obj::Allocated::FORWARDED )
+             ? static_cast<Forwarded *>(object)->to
+             : evacuate(object);
+
+        return;
+    }
+
+    // Visited once the nursery has been collected, see collectGarbage
+    if( ( mFull || mPhase == Phase::Marking ) && ! isMarked(object) ) {
+        setMarked(object);
+        mGray.push_back(object);
+    }
+}
+
+obj::Allocated *MemoryManager::evacuate(obj::Allocated *object)
+{
+    const auto & type = obj::descriptor(object->type());
+    const auto moved = relocate(object);
+    setMarked(moved);
+    mAllocatedObjects.push_back(moved);
+    mMarkStack.push_back(moved);
+
+    // Young objects before the barrier stay in the nursery and may be referenced by the moved object
+    const auto hasPointers = type.hasPointerItems || ! type.pointerOffsets.empty();
+    if( hasPointers && mBarriers.back().young != mNursery.get() ) remember(moved);
+
+    return moved;
+}
+
+obj::Allocated *MemoryManager::relocate(obj::Allocated *object)
+{
+    const auto sizeClass = object->mSizeClass;
+    const auto & type = obj::descriptor(object->type());
+
+    const auto to = mArena.allocate(slotSize(sizeClass));
+    if( type.relocate ) {
+        type.relocate(object, to);
+    } else {
+        std::memcpy(to, object, type.size);
+    }
+
+    const auto moved = static_cast<obj::Allocated *>(to);
+    const auto forwarded = new (object) Forwarded(moved->type(), moved);
+    forwarded->mSizeClass = sizeClass;
+    forwarded->mFlags = obj::Allocated::FORWARDED;
+
+    return moved;
+}
+
+template<typename Fn>
+void MemoryManager::forEachPointer(obj::Allocated *object, Fn fn)
+{
+    const auto & type = obj::descriptor(object->type());
+    const auto base = reinterpret_cast<char *>(object);
+    for(const auto offset : type.pointerOffsets) {
+        fn(reinterpret_cast<Object *>(base + offset)->as_ptr);
+    }
+    if( type.hasPointerItems ) {
+        for(auto & item : static_cast<obj::List *>(object)->mItems) fn(item.as_ptr);
+    }
+}
+
+void MemoryManager::scan(obj::Allocated *object)
+{
+    forEachPointer(object, [this](obj::Allocated *& slot) { visit(slot); });
+}
+
+void MemoryManager::drainMarkStack()
+{
+    while( ! mMarkStack.empty() ) {
+        const auto object = mMarkStack.back();
+        mMarkStack.pop_back();
+        scan(object);
+    }
+}
+
+void MemoryManager::drainGray()
+{
+    if( ! isParallel() ) {
+        while( ! mGray.empty() ) {
+            const auto object = mGray.back();
+            mGray.pop_back();
+            scan(object);
+            drainMarkStack();
+        }
+
+        return;
+    }
+
+    const auto numWorkers = mWorkers->size();
+    MarkQueue queue(numWorkers);
+    for(size_t i = 0; i < numWorkers; i++) {
+        queue.add({mGray.begin() + mGray.size() * i / numWorkers, mGray.begin() + mGray.size() * ( i + 1 ) / numWorkers});
+    }
+    mGray.clear();
+    mWorkers->run([&](size_t) { markShared(queue); });
+
+    // Workers leave young objects alone. Only remembered objects point to them, those which have been reached
+    // move them out of the nursery now. Scanning an object twice does no harm
+    for(size_t i = 0; i < mRemembered.size(); i++) {
+        if( isMarked(mRemembered[i]) ) scan(mRemembered[i]);
+    }
+    drainMarkStack();
+    if( ! mGray.empty() ) drainGray();
+}
+
+void MemoryManager::markShared(MarkQueue &queue)
+{
+    // Old objects only point into the nursery if they are remembered, and the nursery collection has
+    // scanned those already. Young objects which remain before the barrier have been scanned as well
+    std::vector<obj::Allocated *> stack;
+    while( queue.take(stack) ) {
+        while( ! stack.empty() ) {
+            const auto object = stack.back();
+            stack.pop_back();
+            forEachPointer(object, [&](obj::Allocated *& slot) {
+                if( slot && ! isYoung(slot) && claim(slot) ) stack.push_back(slot);
+            });
+            queue.share(stack);
+        }
+    }
+}
+
+template<typename Fn>
+void MemoryManager::forEachYoung(char *begin, char *end, Fn fn) const
+{
+    for(auto position = begin; position < end; ) {
+        const auto object = reinterpret_cast<obj::Allocated *>(position);
+        position += slotSize(object->mSizeClass);
+        fn(object);
+    }
+}
+
+void MemoryManager::remember(obj::Allocated *object)
+{
+    object->mFlags |= obj::Allocated::REMEMBERED;
+    mRemembered.push_back(object);
+}
+
+void MemoryManager::collectGarbage()
 {
     if( mBarriers.empty() ) {
 
         throw CompilerBug {"MemoryManager::mBarriers must not be empty"};
     }
-    const auto barrier = *mBarriers.rbegin();
+    const auto barrier = mBarriers.back();
+    mBarriers.back().allocatedBytes = mAllocatedBytes;
+
+    // Besides the roots, objects which are not collected may point to young objects
+    forEachYoung(mNursery.get(), barrier.young, [&](obj::Allocated * object) { scan(object); });
+    if( mFull ) {
+        scanRememberedBefore(barrier);
+    } else {
+        for(size_t i = 0; i < mRemembered.size(); i++) {
+            scan(mRemembered[i]);
+        }
+    }
+    drainMarkStack();
+    if( mFull ) drainGray();
+
+    // Survivors have been moved out, whatever is left after the barrier is garbage
+    forEachYoung(barrier.young, mNurseryTop, [&](obj::Allocated * object) {
+        if( ! ( object->mFlags & obj::Allocated::FORWARDED ) ) destroy(object);
+    });
+    mNurseryTop = barrier.young;
+
+    auto pause = HeapStatistics::Pause::Nursery;
+    if( mFull ) {
+        sweep(barrier.old);
+        pause = HeapStatistics::Pause::Full;
+    } else if( mPhase != Phase::Idle ) {
+        step(barrier.old);
+        pause = HeapStatistics::Pause::Slice;
+    }
+
+    // Nothing can point into an empty nursery. Objects written to by functions must be
+    // remembered until the function returns, they may be the only way to reach objects the
+    // function created, see push
+    if( mNurseryTop == mNursery.get() && mBarriers.size() == 1 ) {
+        for(auto object : mRemembered) object->mFlags &= ~obj::Allocated::REMEMBERED;
+        mRemembered.clear();
+    }
+
+    if( mCompact && ( mCompactAlways || isFragmented() ) ) {
+        compact();
+        pause = HeapStatistics::Pause::Compaction;
+    }
+    mRootSlots.clear();
+
+    if( mStatistics ) {
+        mStatistics->collected(pause, std::chrono::steady_clock::now() - mCollectionStart, mFreedBytes - mFreedBytesAtStart);
+    }
+}
+
+void MemoryManager::scanRememberedBefore(const Barrier &barrier)
+{
+    // Everything is collected at the base barrier
+    if( barrier.old == 0 ) return;
+
+    // Remembered objects after the barrier are only scanned once they are reached, s.t. dead ones keep nothing alive
+    const auto numObjects = mAllocatedObjects.size();
+    for(auto i = barrier.old; i < numObjects; i++) mAllocatedObjects[i]->mFlags |= obj::Allocated::REGION;
+    for(size_t i = 0; i < mRemembered.size(); i++) {
+        if( ! ( mRemembered[i]->mFlags & obj::Allocated::REGION ) ) scan(mRemembered[i]);
+    }
+    for(auto i = barrier.old; i < numObjects; i++) mAllocatedObjects[i]->mFlags &= ~obj::Allocated::REGION;
+}
+
+bool MemoryManager::isFragmented() const
+{
+    size_t used = 0;
+    for(const auto object : mAllocatedObjects) {
+        if( object->mSizeClass != Arena::large ) used += slotSize(object->mSizeClass);
+    }
+
+    return 2 * used < mArena.reserved();
+}
+
+void MemoryManager::compact()
+{
+    // Objects are marked anew as they are reached. Large objects stay where they are,
+    // and objects the manager does not own are neither moved nor counted
+    nextEpoch();
+    mArena.beginCompaction();
+
+    std::vector<obj::Allocated *> reached;
+    const auto move = [&](obj::Allocated *& slot) {
+        const auto object = slot;
+        if( ! object || isImmortal(object) ) return;
+
+        if( object->mFlags & obj::Allocated::FORWARDED ) {
+            slot = static_cast<Forwarded *>(object)->to;
+        } else if( ! isMarked(object) ) {
+            slot = ( object->mSizeClass == Arena::large ) ? object : relocate(object);
+            setMarked(slot);
+            reached.push_back(slot);
+        }
+    };
+
+    // Breadth first, s.t. the items of a list are moved next to each other
+    for(const auto root : mRootSlots) move(*root);
+    for(size_t i = 0; i < reached.size(); i++) forEachPointer(reached[i], move);
+
+    if( reached.size() != mAllocatedObjects.size() ) {
+
+        throw CompilerBug {"MemoryManager::compact() did not reach every object, roots are missing"};
+    }
+    mAllocatedObjects = std::move(reached);
+
+    mArena.finishCompaction();
+}
+
+void MemoryManager::sweep(size_t begin)
+{
+    mSweepBegin = mSweepPosition = begin;
+    mSweepEnd = mAllocatedObjects.size();
+    if( isParallel() ) {
+        sweepShared();
+    } else {
+        sweepSlice({});
+    }
+    finishSweep();
+}
+
+void MemoryManager::step(size_t begin)
+{
+    Slice slice(mSliceBudget);
+
+    if( mPhase == Phase::Marking ) {
+        while( ! mGray.empty() && slice.next() ) {
+            const auto object = mGray.back();
+            mGray.pop_back();
+            scan(object);
+        }
+        if( ! mGray.empty() ) return;
+
+        // The roots of this collection, the remembered objects and the survivors of the nursery
+        // have been visited. Everything else after the barrier has been unreachable since
+        mPhase = Phase::Sweeping;
+        mSweepBegin = mSweepPosition = begin;
+        mSweepEnd = mAllocatedObjects.size();
+
+        return;
+    }
 
-    const auto n = mAllocatedObjects.size();
+    sweepSlice(mSliceBudget);
+    if( mSweepPosition == mSweepEnd ) finishSweep();
+}
+
+void MemoryManager::sweepSlice(SliceBudget budget)
+{
+    // Remembered objects are deleted after they have been removed from mRemembered
+    Slice slice(budget);
+    for(; mSweepPosition < mSweepEnd && slice.next(); mSweepPosition++) {
+        auto & object = mAllocatedObjects[mSweepPosition];
+        if( ! object || isMarked(object) ) continue;
+
+        if( object->mFlags & obj::Allocated::REMEMBERED ) {
+            object->mFlags &= ~obj::Allocated::REMEMBERED;
+            mDeadRemembered.push_back(object);
+        } else {
+            destroy(object);
+        }
+        object = nullptr;
+    }
+}
 
-    // TODO: Make more efficient by overwriting vector in same iteration
-    std::vector<std::unique_ptr<obj::Allocated> > keep;
-    for(size_t i = barrier; i < n; i++) {
-        auto & obj = mAllocatedObjects[i];
-        if( toBeKept.count(obj.get()) ) {
-            keep.push_back(std::move(obj));
+void MemoryManager::sweepShared()
+{
+    struct Dead
+    {
+        /// Memory to return to the arena, which is not shared
+        std::vector<std::pair<obj::Allocated *, uint8_t> > slots;
+        std::vector<obj::Allocated *> remembered;
+        size_t bytes = 0;
+    };
+
+    const auto numWorkers = mWorkers->size();
+    const auto begin = mSweepPosition;
+    const auto count = mSweepEnd - begin;
+    std::vector<Dead> dead(numWorkers);
+    mWorkers->run([&](size_t worker) {
+        auto & own = dead[worker];
+        const auto end = begin + count * ( worker + 1 ) / numWorkers;
+        for(auto i = begin + count * worker / numWorkers; i < end; i++) {
+            auto & object = mAllocatedObjects[i];
+            if( ! object || isMarked(object) ) continue;
+
+            if( object->mFlags & obj::Allocated::REMEMBERED ) {
+                object->mFlags &= ~obj::Allocated::REMEMBERED;
+                own.remembered.push_back(object);
+            } else {
+                own.bytes += size(object);
+                own.slots.emplace_back(object, object->mSizeClass);
+                const auto destroy = obj::descriptor(object->type()).destroy;
+                if( destroy ) destroy(object);
+            }
+            object = nullptr;
         }
+    });
+
+    for(const auto & own : dead) {
+        for(const auto & slot : own.slots) mArena.deallocate(slot.first, slot.second);
+        mFreedBytes += own.bytes;
+        mDeadRemembered.insert(mDeadRemembered.end(), own.remembered.begin(), own.remembered.end());
+    }
+    mSweepPosition = mSweepEnd;
+}
+
+void MemoryManager::finishSweep()
+{
+    // Barriers pushed since the sweep began refer to positions after the deleted objects
+    size_t kept = mSweepBegin;
+    auto barrier = mBarriers.begin();
+    for(; barrier != mBarriers.end() && barrier->old < mSweepBegin; barrier++);
+    for(size_t i = mSweepBegin; i < mAllocatedObjects.size(); i++) {
+        for(; barrier != mBarriers.end() && barrier->old == i; barrier++) barrier->old = kept;
+        if( mAllocatedObjects[i] ) mAllocatedObjects[kept++] = mAllocatedObjects[i];
+    }
+    for(; barrier != mBarriers.end(); barrier++) barrier->old = kept;
+    mAllocatedObjects.resize(kept);
+    destroyDeadRemembered();
+
+    mFullThreshold = std::max(minFullThreshold, 2 * mAllocatedObjects.size());
+    mPhase = Phase::Idle;
+}
+
+void MemoryManager::destroyDeadRemembered()
+{
+    if( mDeadRemembered.empty() ) return;
+
+    mRemembered.erase(std::remove_if(mRemembered.begin(), mRemembered.end(), [](const obj::Allocated * object) {
+        return ! ( object->mFlags & obj::Allocated::REMEMBERED );
+    }), mRemembered.end());
+    for(auto object : mDeadRemembered) destroy(object);
+    mDeadRemembered.clear();
+}
+
+void MemoryManager::finishIncremental()
+{
+    if( mPhase == Phase::Marking ) {
+        // A full collection marks everything anew
+        mGray.clear();
+        mPhase = Phase::Idle;
+    } else if( mPhase == Phase::Sweeping ) {
+        sweepSlice({});
+        finishSweep();
+    }
+}
+
+void MemoryManager::clear()
+{
+    for(auto object : mAllocatedObjects) {
+        if( object ) destroy(object);
     }
+    mAllocatedObjects.clear();
+    for(auto object : mDeadRemembered) destroy(object);
+    mDeadRemembered.clear();
+    mGray.clear();
+    mPhase = Phase::Idle;
+
+    forEachYoung(mNursery.get(), mNurseryTop, [&](obj::Allocated * object) {
+        if( ! ( object->mFlags & obj::Allocated::FORWARDED ) ) destroy(object);
+    });
+    mNurseryTop = mNursery.get();
+
+    mBarriers.assign(1, {0, mNurseryTop, mAllocatedBytes});
+    mRemembered.clear();
+    mFullThreshold = minFullThreshold;
+    mArena.clear();
+}
+
+std::vector<HeapStatistics::Count> MemoryManager::census() const
+{
+    std::vector<HeapStatistics::Count> ret;
+    const auto count = [&](const obj::Allocated * object) {
+        if( object->type() >= ret.size() ) ret.resize(object->type() + 1);
+        ret[object->type()].objects++;
+        ret[object->type()].bytes += size(object);
+    };
+    for(const auto object : mAllocatedObjects) {
+        if( object ) count(object);
+    }
+    for(const auto object : mDeadRemembered) count(object);
+    forEachYoung(mNursery.get(), mNurseryTop, count);
+
+    return ret;
+}
+
+size_t MemoryManager::size(const obj::Allocated *object)
+{
+    return ( object->mSizeClass == Arena::large ) ? obj::descriptor(object->type()).size : slotSize(object->mSizeClass);
+}
+
+void MemoryManager::destroy(obj::Allocated *object)
+{
+    mFreedBytes += size(object);
+    const auto sizeClass = object->mSizeClass;
+    const auto destroy = obj::descriptor(object->type()).destroy;
+    if( destroy ) destroy(object);
 
-    mAllocatedObjects.resize(barrier);
-    for(auto & ptr : keep) mAllocatedObjects.push_back(std::move(ptr));
+    // The nursery is reused as a whole
+    if( ! isYoung(object) ) mArena.deallocate(object, sizeClass);
 }
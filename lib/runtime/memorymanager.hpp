@@ -1,14 +1,139 @@
 #pragma once
+#include "arena.hpp"
 #include "common/exceptions.hpp"
+#include "heapstatistics.hpp"
 #include "objects/allocated.hpp"
+#include <chrono>
 #include <memory>
-#include <map>
-#include <set>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+
+class WorkerPool;
+
+
+/// Owns all objects created while executing a program.
+///
+/// New objects are allocated in the nursery, a small region filled by bumping a pointer.
+/// Most objects die young: a collection moves the survivors from the nursery into the arena,
+/// after which the nursery is reused from the start. Objects in the arena are only
+/// collected when the arena has grown considerably since its last collection, either at once
+/// or incrementally in slices spread over many collections, see setSliceBudget.
+/// Collecting all of a large arena at once can be shared among threads, see setCollectorThreads.
+/// Survivors in a fragmented arena can be moved next to each other, see setCompaction.
 class MemoryManager
 {
 public:
-    obj::Allocated * add(std::unique_ptr<obj::Allocated> ptr);
+
+    /// Default size of the nursery in bytes
+    static constexpr size_t defaultNurserySize = 256 * 1024;
+
+    /// Default for setGrowthThreshold. Collecting before the nursery overflows keeps survivors out of the arena
+    static constexpr size_t defaultGrowthThreshold = defaultNurserySize / 2;
+
+    enum class Collection
+    {
+        /// Nursery only, unless the arena has grown past its threshold
+        Automatic,
+        /// Nursery and arena
+        Full,
+        /// As Full, then move the survivors in the arena next to each other, see setCompaction.
+        /// Only at the base barrier, elsewhere the same as Full
+        Compact,
+    };
+
+    /// Work of one collection while collecting the arena incrementally, see setSliceBudget
+    struct SliceBudget
+    {
+        /// Objects to mark or sweep, zero for no limit
+        size_t objects = 0;
+        /// Time to spend marking or sweeping, zero for no limit
+        std::chrono::microseconds time {0};
+
+        bool unlimited() const { return objects == 0 && time.count() == 0; }
+    };
+
+    explicit MemoryManager(size_t nurserySize = defaultNurserySize);
+    MemoryManager(const MemoryManager &) = delete;
+    MemoryManager & operator=(const MemoryManager &) = delete;
+    ~MemoryManager();
+
+    /// Construct an object in memory owned by this manager
+    template<typename T, typename... Args>
+    T * make(Args &&... args)
+    {
+        static_assert(std::is_base_of_v<obj::Allocated, T>, "Only objects derived from obj::Allocated are managed");
+        constexpr auto sizeClass = Arena::sizeClass(sizeof(T));
+        constexpr auto slotSize = ( sizeClass + 1 ) * Arena::granularity;
+
+        const auto young = sizeClass != Arena::large && mNurseryTop + slotSize <= mNurseryEnd;
+        const auto memory = young ? mNurseryTop : mArena.allocate(sizeof(T));
+        T * ret;
+        try {
+            ret = new (memory) T(std::forward<Args>(args)...);
+        } catch(...) {
+            if( ! young ) mArena.deallocate(memory, sizeClass);
+            throw;
+        }
+        ret->mSizeClass = sizeClass;
+
+        mAllocatedBytes += slotSize;
+        if( mStatistics ) mStatistics->allocated(ret->type(), sizeClass == Arena::large ? sizeof(T) : slotSize);
+        if( young ) {
+            mNurseryTop += slotSize;
+        } else {
+            mAllocatedObjects.push_back(ret);
+        }
+
+        return ret;
+    }
+
+    /// Let every memory manager leave object alone: it is never marked, moved or deleted. For objects which
+    /// live outside of any manager but may be pointed to by managed ones, see ConstantPool
+    static void setImmortal(obj::Allocated * object) { object->mFlags |= obj::Allocated::IMMORTAL; }
+
+    /// Call after storing a pointer into object, see ins::WriteBarrier. Objects outside of the nursery are
+    /// remembered and scanned by the following collections, s.t. the objects they point to are found without
+    /// scanning the whole arena. This covers pointers into the nursery, as well as pointers stored into
+    /// objects which an incremental collection has already marked
+    void writeBarrier(obj::Allocated * object)
+    {
+        if( ! isYoung(object) && ! ( object->mFlags & obj::Allocated::REMEMBERED ) ) remember(object);
+    }
+
+    /// Safepoints only collect after this many bytes of objects have been allocated since the
+    /// objects after the latest barrier were last collected, see needsCollection
+    void setGrowthThreshold(size_t bytes) { mGrowthThreshold = bytes; }
+
+    /// Whether a collection at a safepoint is worth it, see ins::Safepoint
+    bool needsCollection() const
+    {
+        return mAllocatedBytes - mBarriers.back().allocatedBytes >= mGrowthThreshold;
+    }
+
+    /// Mark and sweep the arena in slices of the given budget, one slice per collection, s.t. pauses
+    /// do not grow with the heap. An unlimited budget, the default, collects the arena at once
+    void setSliceBudget(SliceBudget budget) { mSliceBudget = budget; }
+
+    /// Mark and sweep the arena on numThreads threads, including the calling one, when collecting all of it
+    /// at once. Only arenas of many objects are worth the threads. The default is the calling thread alone
+    void setCollectorThreads(size_t numThreads);
+
+    /// Let collections of the arena at the base barrier compact it when less than half of its pages is in use.
+    /// Survivors are moved to new pages in the order in which they are reached from the roots, s.t. lists lie next
+    /// to their items. Off by default
+    void setCompaction(bool enabled) { mCompaction = enabled; }
+
+    /// Bytes held for objects, whether they are alive or not
+    size_t reserved() const { return mNurserySize + mArena.reserved(); }
+
+    /// Record allocations and collections in statistics from now on, nullptr to stop
+    void setStatistics(HeapStatistics * statistics) { mStatistics = statistics; }
+
+    /// Objects held per type, indexed by obj::TypeIndex. Includes objects which are unreachable but not yet deleted
+    std::vector<HeapStatistics::Count> census() const;
 
     /// Add a barrier for garbage collection
     void push();
@@ -16,14 +141,197 @@ public:
     /// Remove latest barrier for garbage collection
     void pop();
 
-    /// Will delete anything which is not in the 'keep' list
-    void collectGarbage(const std::set<const obj::Allocated *> &toBeKept);
+    /// Remove latest barrier and delete the objects allocated since, except for result and everything reachable
+    /// from it. result is updated if it moves, nullptr keeps nothing. Only valid if no object allocated since the
+    /// barrier is reachable from older objects. Takes time in the number of objects allocated since the barrier,
+    /// as those need to be destroyed. Falls back to pop while an incremental collection is in progress
+    void popRegion(obj::Allocated ** result);
+
+    /// Start a collection. Call mark for every root, then collectGarbage
+    void beginCollection(Collection collection = Collection::Automatic);
+
+    /// Keep root and everything reachable from it alive. Objects may move out of the nursery or within the arena,
+    /// root is updated accordingly and must stay in place until collectGarbage. Does not recurse, s.t. deeply nested objects cannot overflow the stack
+    void mark(obj::Allocated *& root);
+
+    /// Delete every object after the latest barrier which has not been marked since beginCollection
+    void collectGarbage();
+
+    /// Delete all objects and barriers, but keep the storage for reuse
+    void clear();
+
+    bool isYoung(const obj::Allocated * object) const
+    {
+        return static_cast<size_t>(reinterpret_cast<const char *>(object) - mNursery.get()) < mNurserySize;
+    }
 
 private:
-    std::vector<std::unique_ptr<obj::Allocated> > mAllocatedObjects;
-    std::vector<size_t> mBarriers = {0};
-};
 
+    struct Barrier
+    {
+        /// Index into mAllocatedObjects
+        size_t old;
+        /// Top of the nursery
+        char * young;
+        /// Value of mAllocatedBytes when the objects after the barrier were last collected
+        size_t allocatedBytes;
+    };
+
+    void remember(obj::Allocated * object);
+
+    /// Where an incremental collection of the arena stands
+    enum class Phase { Idle, Marking, Sweeping };
+
+    /// Gray objects handed between threads marking in parallel, see markShared
+    class MarkQueue;
+
+    static bool isImmortal(const obj::Allocated * object)
+    {
+        return object->mFlags & obj::Allocated::IMMORTAL;
+    }
+
+    bool isMarked(const obj::Allocated * object) const
+    {
+        return object->mMark.load(std::memory_order_relaxed) == mEpoch;
+    }
+
+    void setMarked(obj::Allocated * object)
+    {
+        object->mMark.store(mEpoch, std::memory_order_relaxed);
+    }
+
+    /// Mark object unless it is marked already, also if other threads try the same. True if this call marked it
+    bool claim(obj::Allocated * object)
+    {
+        return ! isImmortal(object) && ! isMarked(object) && object->mMark.exchange(mEpoch, std::memory_order_relaxed) != mEpoch;
+    }
+
+    /// Visit slot during marking, moving the object it points to out of the nursery if necessary
+    void visit(obj::Allocated *& slot);
+
+    /// Move young object into the arena, leaving a forwarding pointer behind
+    obj::Allocated * evacuate(obj::Allocated * object);
 
-// TODO: not singleton, make member of executor
-MemoryManager &memory();
+    /// Move object to a new slot in the arena, leaving a forwarding pointer behind
+    obj::Allocated * relocate(obj::Allocated * object);
+
+    /// Less than half of the pages of the arena hold objects
+    bool isFragmented() const;
+
+    /// Move every object in the arena to new pages, in the order in which they are reached from mRootSlots.
+    /// Only at the base barrier with an empty nursery, after everything unreachable has been deleted
+    void compact();
+
+    /// Call fn(obj::Allocated *& slot) for every pointer of object
+    template<typename Fn>
+    static void forEachPointer(obj::Allocated * object, Fn fn);
+
+    /// Visit pointers of object, see visit
+    void scan(obj::Allocated * object);
+    void drainMarkStack();
+
+    /// Scan the remembered objects allocated before barrier, which a full collection does not reach from the roots
+    void scanRememberedBefore(const Barrier & barrier);
+
+    /// Visit every object reachable from mGray
+    void drainGray();
+
+    /// Worker of drainGray marking on several threads
+    void markShared(MarkQueue & queue);
+
+    /// Whether to collect the arena on the threads of mWorkers
+    bool isParallel() const;
+
+    /// Start a new round of marks
+    void nextEpoch();
+
+    /// Delete unmarked objects in the arena from begin on
+    void sweep(size_t begin);
+
+    /// Continue marking or sweeping the arena incrementally, begin as for sweep
+    void step(size_t begin);
+
+    /// Delete unmarked objects from mSweepPosition up to mSweepEnd, as far as budget allows
+    void sweepSlice(SliceBudget budget);
+
+    /// As sweepSlice without a budget, on the threads of mWorkers
+    void sweepShared();
+
+    /// Remove the objects deleted by sweepSlice from mAllocatedObjects
+    void finishSweep();
+
+    /// Remove the objects of mDeadRemembered from mRemembered and delete them
+    void destroyDeadRemembered();
+
+    /// Complete or abandon an incremental collection, s.t. the arena can be collected at once
+    void finishIncremental();
+
+    /// Call fn for every object in the nursery from begin up to end
+    template<typename Fn>
+    void forEachYoung(char * begin, char * end, Fn fn) const;
+
+    void destroy(obj::Allocated * object);
+
+    /// Bytes occupied by object, see Arena::sizeClass
+    static size_t size(const obj::Allocated * object);
+
+    Arena mArena;
+
+    /// Objects in the arena, in order of allocation, s.t. barriers can refer to the objects allocated after them
+    std::vector<obj::Allocated *> mAllocatedObjects;
+    std::vector<Barrier> mBarriers;
+
+    const size_t mNurserySize;
+    const std::unique_ptr<char[]> mNursery;
+    char * mNurseryTop;
+    char * const mNurseryEnd;
+
+    /// Objects outside the nursery which have been written to, see writeBarrier
+    std::vector<obj::Allocated *> mRemembered;
+
+    /// Total of all allocations, never reset s.t. every barrier can tell the growth since its last collection
+    size_t mAllocatedBytes = 0;
+    size_t mGrowthThreshold = defaultGrowthThreshold;
+
+    /// Collect the arena when it holds this many objects
+    size_t mFullThreshold;
+    bool mFull = false;
+
+    SliceBudget mSliceBudget;
+
+    /// nullptr while collecting on the calling thread alone
+    std::unique_ptr<WorkerPool> mWorkers;
+
+    bool mCompaction = false;
+
+    HeapStatistics * mStatistics = nullptr;
+    std::chrono::steady_clock::time_point mCollectionStart;
+
+    /// Total of all deletions, see HeapStatistics::collected
+    size_t mFreedBytes = 0;
+    size_t mFreedBytesAtStart = 0;
+
+    /// Whether the current collection may compact the arena, s.t. mark records the roots
+    bool mCompact = false;
+    bool mCompactAlways = false;
+    std::vector<obj::Allocated **> mRootSlots;
+    Phase mPhase = Phase::Idle;
+
+    /// Marked objects in the arena whose children have yet to be visited. Nursery collections leave them for
+    /// later, s.t. the arena can be marked incrementally or in parallel once the survivors have moved out
+    std::vector<obj::Allocated *> mGray;
+
+    /// Range of mAllocatedObjects left to sweep. Deleted objects are replaced by nullptr until finishSweep
+    size_t mSweepBegin = 0;
+    size_t mSweepPosition = 0;
+    size_t mSweepEnd = 0;
+
+    /// Dead objects which are deleted once finishSweep has removed them from mRemembered
+    std::vector<obj::Allocated *> mDeadRemembered;
+
+    /// Objects are marked by writing the number of the collection, s.t. marks never need to be reset
+    uint32_t mEpoch = 0;
+
+    /// Marked objects whose children have yet to be visited, kept between collections
+    std::vector<obj::Allocated *> mMarkStack;
+};
@@ -0,0 +1,95 @@
+#include "allocated.hpp"
+#include "list.hpp"
+#include "string.hpp"
+#include "common/exceptions.hpp"
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+
+namespace obj {
+
+namespace {
+
+    constexpr size_t chunkSize = 256;
+    constexpr size_t numChunks = ( size_t {std::numeric_limits<TypeIndex>::max()} + 1 ) / chunkSize;
+
+    /// Descriptors never move once registered, s.t. they can be read while other types are registered
+    class Registry
+    {
+    public:
+
+        Registry()
+        {
+            add({"Opaque", sizeof(Childless), {}, false, nullptr, nullptr});
+            add({"String", sizeof(String), {}, false, &destroyAs<String>, &relocateAs<String>});
+            add({"List", sizeof(List), {}, false, &destroyAs<List>, &relocateAs<List>});
+            add({"List of allocated", sizeof(List), {}, true, &destroyAs<List>, &relocateAs<List>});
+        }
+
+        TypeIndex add(TypeDescriptor descriptor)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            const auto found = mIndices.find(descriptor.name);
+            if( found != mIndices.end() ) return found->second;
+
+            const auto index = mSize;
+            if( index / chunkSize == numChunks ) {
+
+                throw MissingFeature { "Too many types" };
+            }
+
+            auto & chunk = mChunks[index / chunkSize];
+            if( ! chunk.load(std::memory_order_relaxed) ) {
+                chunk.store(new TypeDescriptor[chunkSize], std::memory_order_release);
+            }
+
+            mIndices.emplace(descriptor.name, index);
+            chunk.load(std::memory_order_relaxed)[index % chunkSize] = std::move(descriptor);
+            mSize++;
+
+            return index;
+        }
+
+        const TypeDescriptor & get(TypeIndex index) const
+        {
+            return mChunks[index / chunkSize].load(std::memory_order_acquire)[index % chunkSize];
+        }
+
+        ~Registry()
+        {
+            for(auto & chunk : mChunks) delete[] chunk.load();
+        }
+
+    private:
+        std::mutex mMutex;
+        std::atomic<TypeDescriptor *> mChunks[numChunks] = {};
+        size_t mSize = 0;
+        std::unordered_map<std::string, TypeIndex> mIndices;
+    };
+
+    Registry & registry()
+    {
+        static Registry ret;
+
+        return ret;
+    }
+
+}
+
+
+TypeIndex registerType(TypeDescriptor descriptor)
+{
+    return registry().add(std::move(descriptor));
+}
+
+const TypeDescriptor & descriptor(TypeIndex type)
+{
+    return registry().get(type);
+}
+
+} // namespace obj
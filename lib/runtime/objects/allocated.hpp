@@ -1,25 +1,130 @@
 #pragma once
+#include <atomic>
+#include <cstdint>
+#include <new>
+#include <string>
+#include <utility>
 #include <vector>
 
 
+class MemoryManager;
+
+
 namespace obj {
 
 
+/// Index into the table of type descriptors, see descriptor()
+using TypeIndex = uint16_t;
+
+
+/// Header of every object on the heap.
+///
+/// There is no vtable: everything the memory manager needs to know about an object
+/// is found in the descriptor of its type.
 class Allocated
 {
 public:
 
-    // TODO: return iterator, not vector
-    virtual std::vector<const Allocated *> children() const = 0;
+    explicit Allocated(TypeIndex type): mType(type) {}
+
+    Allocated(const Allocated & other)
+        : mMark(other.mMark.load(std::memory_order_relaxed))
+        , mType(other.mType)
+        , mSizeClass(other.mSizeClass)
+        , mFlags(other.mFlags)
+    {
+    }
+
+    TypeIndex type() const { return mType; }
+
+private:
+    friend class ::MemoryManager;
+
+    /// Number of the last collection which found this object reachable, see MemoryManager::mark.
+    /// Atomic s.t. workers marking in parallel claim every object once
+    mutable std::atomic<uint32_t> mMark {0};
+
+    const TypeIndex mType;
 
-    virtual ~Allocated() {}
+    /// Where the memory of the object came from, see Arena::sizeClass
+    uint8_t mSizeClass = 0;
+
+    enum Flags: uint8_t
+    {
+        /// Listed by the memory manager as written to, see MemoryManager::writeBarrier
+        REMEMBERED = 1,
+        /// Moved out of the nursery, see MemoryManager::evacuate
+        FORWARDED = 2,
+        /// Allocated since the latest barrier, while it is being removed or collected, see MemoryManager::popRegion
+        REGION = 4,
+        /// Not owned by any memory manager, which leaves it alone, see MemoryManager::setImmortal
+        IMMORTAL = 8,
+    };
+
+    uint8_t mFlags = 0;
 };
 
+static_assert(sizeof(Allocated) == 8, "Object header should stay compact");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Marking must not take locks");
+
+
+/// Layout of the objects of one type
+struct TypeDescriptor
+{
+    std::string name;
+
+    /// Bytes occupied by an object, including the header
+    uint32_t size = 0;
+
+    /// Fields which point to other objects, as offsets in bytes from the header
+    std::vector<uint32_t> pointerOffsets;
+
+    /// The object is a List whose items point to other objects
+    bool hasPointerItems = false;
+
+    /// Run the destructor, nullptr if there is nothing to do
+    void (*destroy)(Allocated *) = nullptr;
+
+    /// Move object to memory at to and destroy the original, nullptr if copying the bytes suffices
+    void (*relocate)(Allocated * object, void * to) = nullptr;
+};
+
+
+template<typename T>
+void destroyAs(Allocated * object)
+{
+    static_cast<T *>(object)->~T();
+}
+
+template<typename T>
+void relocateAs(Allocated * object, void * to)
+{
+    new (to) T(std::move(*static_cast<T *>(object)));
+    static_cast<T *>(object)->~T();
+}
+
+
+/// Types known without registration
+enum BuiltinType: TypeIndex
+{
+    OPAQUE,
+    STRING,
+    LIST_OF_SIMPLE,
+    LIST_OF_ALLOCATED,
+};
+
+
+/// Add a descriptor to the table. Registering a name twice yields the index of the first registration
+TypeIndex registerType(TypeDescriptor descriptor);
+
+const TypeDescriptor & descriptor(TypeIndex type);
+
 
+/// Object whose contents are of no concern to the memory manager
 class Childless: public Allocated
 {
 public:
-    std::vector<const Allocated *> children() const override { return {}; }
+    Childless(): Allocated(OPAQUE) {}
 };
 
 } // namespace obj
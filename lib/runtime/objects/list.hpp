@@ -1,7 +1,7 @@
 #pragma once
 #include "allocated.hpp"
 #include "common/object.hpp"
-#include <memory>
+#include <vector>
 
 
 namespace obj {
@@ -10,25 +10,14 @@ namespace obj {
 class List: public Allocated
 {
 public:
-    std::vector<Object> mItems;
-};
-
-
-class ListOfSimple: public List
-{
-public:
-    std::vector<const Allocated *> children() const override { return {}; }
-};
+    /// Items of a list of allocated items are scanned by the garbage collector
+    explicit List(bool isAllocated)
+        : Allocated(isAllocated ? LIST_OF_ALLOCATED : LIST_OF_SIMPLE)
+    {
+    }
 
-
-class ListOfAllocated: public List
-{
-public:
-    std::vector<const Allocated *> children() const;
+    std::vector<Object> mItems;
 };
 
 
-std::unique_ptr<List> makeList(bool isAllocated);
-
-
 } // namespace obj
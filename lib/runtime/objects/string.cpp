@@ -5,7 +5,8 @@
 namespace obj {
 
 String::String(std::string value)
-    : mValue(std::move(value))
+    : Allocated(STRING)
+    , mValue(std::move(value))
 {
 
 }
@@ -6,7 +6,7 @@
 namespace obj {
 
 // TODO: single pointer
-class String: public Childless
+class String: public Allocated
 {
 public:
     String(std::string value);
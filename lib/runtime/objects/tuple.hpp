@@ -1,7 +1,7 @@
 #pragma once
 #include <array>
 #include <bitset>
-#include "common/exceptions.hpp"
+#include <string>
 #include "common/object.hpp"
 #include "runtime/objects/allocated.hpp"
 
@@ -14,15 +14,25 @@ class Tuple: public Allocated
 {
 public:
 
-    std::array<Object, N> data;
+    explicit Tuple(TypeIndex type): Allocated(type) {}
 
-    std::vector<const Allocated *> children() const
+    std::array<Object, N> data {};
+
+    /// Layout of tuples whose elements at isPointer point to other objects
+    static TypeDescriptor describe(std::string name, const std::bitset<N> & isPointer)
     {
-        throw MissingFeature {"Tuple::children()" };
-    }
+        TypeDescriptor ret {std::move(name), sizeof(Tuple), {}, false, nullptr, nullptr};
 
-private:
-    const std::bitset<N> mIsAllocated;
+        // Not standard layout, so offsetof is not an option
+        const Tuple probe {OPAQUE};
+        const auto offset = reinterpret_cast<const char *>(probe.data.data())
+                          - reinterpret_cast<const char *>(static_cast<const Allocated *>(&probe));
+        for(size_t i = 0; i < N; i++) {
+            if( isPointer[i] ) ret.pointerOffsets.push_back(offset + i * sizeof(Object));
+        }
+
+        return ret;
+    }
 };
 
 
@@ -1,8 +0,0 @@
-#include "output.hpp"
-
-
-Output & getOutput()
-{
-    static Output output;
-    return output;
-}
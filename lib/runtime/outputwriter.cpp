@@ -0,0 +1,129 @@
+#include "outputwriter.hpp"
+
+#include <cerrno>
+#include <iostream>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+    #define GECKO_POSIX_OUTPUT 1
+    #include <sys/uio.h>
+    #include <unistd.h>
+#else
+    #define GECKO_POSIX_OUTPUT 0
+#endif
+
+
+namespace {
+
+    constexpr size_t bufferSize = 64 * 1024;
+
+}
+
+
+OutputWriter::OutputWriter(std::ostream &output)
+    : mBuffer(bufferSize)
+{
+    reset(output);
+}
+
+OutputWriter::~OutputWriter()
+{
+    try {
+        flush();
+    } catch(...) {
+    }
+}
+
+void OutputWriter::reset(std::ostream &output)
+{
+    if( mSize > 0 ) flush();
+
+    mOutput = &output;
+    mDescriptor = -1;
+#if GECKO_POSIX_OUTPUT
+    if( &output == &std::cout ) mDescriptor = STDOUT_FILENO;
+#endif
+}
+
+void OutputWriter::flush()
+{
+    drain();
+    mOutput->flush();
+}
+
+void OutputWriter::drain()
+{
+    if( mSize == 0 ) return;
+
+    if( mDescriptor >= 0 ) {
+        std::string_view pieces[] = {{mBuffer.data(), mSize}};
+        writeDirectly(pieces, 1);
+    } else {
+        mOutput->write(mBuffer.data(), static_cast<std::streamsize>(mSize));
+    }
+    mSize = 0;
+}
+
+void OutputWriter::printLong(std::string_view line)
+{
+    if( line.size() < mBuffer.size() ) {
+        drain();
+        printLine(line);
+
+        return;
+    }
+
+    // Longer than the buffer, not worth copying
+    if( mDescriptor >= 0 ) {
+        std::string_view pieces[] = {{mBuffer.data(), mSize}, line, "\n"};
+        writeDirectly(pieces, 3);
+        mSize = 0;
+    } else {
+        drain();
+        mOutput->write(line.data(), static_cast<std::streamsize>(line.size()));
+        mOutput->put('\n');
+    }
+}
+
+void OutputWriter::writeDirectly(std::string_view *pieces, size_t numPieces)
+{
+#if GECKO_POSIX_OUTPUT
+    // Whatever has been written to the stream itself comes first
+    mOutput->flush();
+
+    constexpr size_t maxPieces = 3;
+    iovec vectors[maxPieces];
+    size_t numVectors = 0;
+    for(size_t i = 0; i < numPieces && numVectors < maxPieces; i++) {
+        if( pieces[i].empty() ) continue;
+
+        vectors[numVectors].iov_base = const_cast<char *>(pieces[i].data());
+        vectors[numVectors].iov_len = pieces[i].size();
+        numVectors++;
+    }
+
+    auto vector = vectors;
+    while( numVectors > 0 ) {
+        const auto result = writev(mDescriptor, vector, static_cast<int>(numVectors));
+        if( result < 0 ) {
+            if( errno == EINTR ) continue;
+
+            throw std::system_error(errno, std::generic_category(), "Cannot write output");
+        }
+
+        // Continue after what has been written, which need not be everything
+        auto written = static_cast<size_t>(result);
+        while( numVectors > 0 && written >= vector->iov_len ) {
+            written -= vector->iov_len;
+            vector++;
+            numVectors--;
+        }
+        if( numVectors > 0 ) {
+            vector->iov_base = static_cast<char *>(vector->iov_base) + written;
+            vector->iov_len -= written;
+        }
+    }
+#else
+    for(size_t i = 0; i < numPieces; i++) mOutput->write(pieces[i].data(), static_cast<std::streamsize>(pieces[i].size()));
+#endif
+}
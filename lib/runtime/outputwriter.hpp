@@ -0,0 +1,86 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+
+/// Writes the lines printed by a program, see printLine.
+///
+/// Output is collected in a large buffer and written in blocks, numbers are formatted with std::to_chars,
+/// s.t. printing costs neither ostream formatting nor locale lookups. On std::cout, the file descriptor is
+/// written directly, and long strings go out together with the buffer in a single writev.
+/// Nothing reaches the stream before flush, or before the buffer fills up, unless it is line buffered
+class OutputWriter
+{
+public:
+
+    explicit OutputWriter(std::ostream & output);
+
+    /// Flushes, but ignores errors
+    ~OutputWriter();
+
+    OutputWriter(const OutputWriter &) = delete;
+    OutputWriter & operator=(const OutputWriter &) = delete;
+
+    /// Flush, then write to output from now on
+    void reset(std::ostream & output);
+
+    void printLine(int64_t value)
+    {
+        // Sign and 19 digits
+        constexpr size_t maxLength = 21;
+        if( mBuffer.size() - mSize < maxLength ) drain();
+
+        const auto begin = mBuffer.data() + mSize;
+        auto end = std::to_chars(begin, begin + maxLength, value).ptr;
+        *end++ = '\n';
+        mSize += end - begin;
+        if( mLineBuffered ) flush();
+    }
+
+    void printLine(std::string_view line)
+    {
+        if( line.size() >= mBuffer.size() - mSize ) {
+            printLong(line);
+            if( mLineBuffered ) flush();
+
+            return;
+        }
+
+        std::memcpy(mBuffer.data() + mSize, line.data(), line.size());
+        mSize += line.size();
+        mBuffer[mSize++] = '\n';
+        if( mLineBuffered ) flush();
+    }
+
+    /// Write everything printed so far to the stream and flush it
+    void flush();
+
+    /// Flush after every line, for interactive use where output must show up before the program waits for
+    /// input. Off by default
+    void setLineBuffered(bool enabled) { mLineBuffered = enabled; }
+
+private:
+
+    /// Write the buffer to the stream
+    void drain();
+
+    /// printLine for lines which do not fit into the rest of the buffer
+    void printLong(std::string_view line);
+
+    /// Write every piece in order, directly to mDescriptor
+    void writeDirectly(std::string_view * pieces, size_t numPieces);
+
+    std::ostream * mOutput;
+
+    /// Descriptor written instead of mOutput, -1 if there is none
+    int mDescriptor = -1;
+
+    std::vector<char> mBuffer;
+    size_t mSize = 0;
+
+    bool mLineBuffered = false;
+};
@@ -0,0 +1,101 @@
+#include "profiler.hpp"
+#include "instructions.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <map>
+
+
+namespace {
+
+    struct Row
+    {
+        uint64_t count = 0;
+        uint64_t cycles = 0;
+        std::string text;
+    };
+
+    void print(std::ostream & stream, const char * what, const std::vector<Row> & rows, uint64_t totalCycles)
+    {
+        stream << std::setw(14) << "executions" << std::setw(16) << "cycles" << std::setw(8) << "%" << "  " << what << "\n";
+        for(const auto & row : rows) {
+            const auto percent = totalCycles ? 100.0 * row.cycles / totalCycles : 0.0;
+            stream << std::setw(14) << row.count
+                   << std::setw(16) << row.cycles
+                   << std::setw(8) << std::fixed << std::setprecision(1) << percent
+                   << "  " << row.text << "\n";
+        }
+    }
+
+    void sortByCycles(std::vector<Row> & rows)
+    {
+        std::stable_sort(rows.begin(), rows.end(), [](const Row & a, const Row & b) { return a.cycles > b.cycles; });
+    }
+
+}
+
+
+Profiler::Profiler(const bc::Program &program, bool measureCycles)
+    : mProgram(program)
+    , mMeasureCycles(measureCycles)
+    , mCounts(program.code.size() + 1)
+    , mCycles(program.code.size() + 1)
+    , mCurrent(program.code.size())
+    , mStart(clock())
+{
+}
+
+uint64_t Profiler::totalCount() const
+{
+    // The last entry counts stop()
+    uint64_t ret = 0;
+    for(size_t offset = 0; offset < mProgram.code.size(); offset++) ret += mCounts[offset];
+
+    return ret;
+}
+
+void Profiler::report(std::ostream &stream, size_t numInstructions) const
+{
+    const auto & code = mProgram.code;
+
+    uint64_t totalCycles = 0;
+    std::vector<Row> instructions(mProgram.origins.size());
+    std::map<std::string, Row> opcodes;
+    for(size_t pc = 0; pc < code.size(); pc += bc::length(&code[pc])) {
+        totalCycles += mCycles[pc];
+
+        const auto name = bc::info(static_cast<bc::Opcode>(code[pc])).name;
+        auto & opcode = opcodes[name];
+        opcode.text = name;
+        opcode.count += mCounts[pc];
+        opcode.cycles += mCycles[pc];
+
+        // Code of inlined functions adds to the cycles of the call
+        if( const auto origin = mProgram.origin(pc) ) {
+            auto & row = instructions[origin - mProgram.origins.data()];
+            if( pc == origin->offset ) row.count = mCounts[pc];
+            row.cycles += mCycles[pc];
+            if( row.text.empty() ) {
+                row.text = mProgram.functions[origin->function].name + " " + std::to_string(origin->ip)
+                         + ": " + origin->instruction->toString();
+            }
+        }
+    }
+
+    instructions.erase(std::remove_if(instructions.begin(), instructions.end(), [](const Row & row) {
+        return row.text.empty() || ! row.count;
+    }), instructions.end());
+    sortByCycles(instructions);
+    if( instructions.size() > numInstructions ) instructions.resize(numInstructions);
+
+    std::vector<Row> perOpcode;
+    for(const auto & pair : opcodes) {
+        if( pair.second.count ) perOpcode.push_back(pair.second);
+    }
+    sortByCycles(perOpcode);
+
+    stream << "Hottest instructions:\n";
+    print(stream, "instruction", instructions, totalCycles);
+    stream << "\nPer opcode:\n";
+    print(stream, "opcode", perOpcode, totalCycles);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "bytecode.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <x86intrin.h>
+#endif
+
+
+/// Execution counts and elapsed cycles per bytecode offset, see run(const bc::Program &, Profiler &)
+class Profiler
+{
+public:
+
+    /// Without measuring cycles, only counting executions is much cheaper
+    explicit Profiler(const bc::Program & program, bool measureCycles = true);
+
+    /// Called before executing the instruction at offset
+    void enter(size_t offset)
+    {
+        mCounts[offset]++;
+        if( ! mMeasureCycles ) return;
+
+        const auto now = clock();
+        mCycles[mCurrent] += now - mStart;
+        mCurrent = offset;
+        mStart = now;
+    }
+
+    /// Called when execution ends
+    void stop() { enter(mProgram.code.size()); }
+
+    /// Hottest instructions with their disassembly, followed by totals per opcode
+    void report(std::ostream & stream, size_t numInstructions = 20) const;
+
+    uint64_t count(size_t offset) const { return mCounts.at(offset); }
+    uint64_t cycles(size_t offset) const { return mCycles.at(offset); }
+
+    /// Number of instructions executed
+    uint64_t totalCount() const;
+
+    /// Time stamp counter where available, nanoseconds otherwise
+    static uint64_t clock()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+private:
+
+    const bc::Program & mProgram;
+    const bool mMeasureCycles;
+
+    /// One entry per offset, the last one stands for time outside of the program
+    std::vector<uint64_t> mCounts;
+    std::vector<uint64_t> mCycles;
+
+    size_t mCurrent;
+    uint64_t mStart;
+};
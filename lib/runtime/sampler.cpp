@@ -0,0 +1,219 @@
+#include "sampler.hpp"
+#include "common/exceptions.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+#include <pthread.h>
+#include <sys/time.h>
+
+#if defined(__linux__)
+    // Timers which signal a single thread, s.t. samples are only taken on the thread which executes the program
+    #define GECKO_THREAD_TIMER 1
+    #include <sys/syscall.h>
+    #include <time.h>
+    #include <unistd.h>
+    #ifndef sigev_notify_thread_id
+        #define sigev_notify_thread_id _sigev_un._tid
+    #endif
+#else
+    #define GECKO_THREAD_TIMER 0
+#endif
+
+
+namespace {
+
+    std::atomic<Sampler *> activeSampler {nullptr};
+
+    struct sigaction previousAction;
+
+    /// Thread which called Sampler::start. Signals delivered to other threads, e.g. the workers of the
+    /// garbage collector or the thread reading input ahead, are ignored
+    pthread_t samplingThread;
+
+#if GECKO_THREAD_TIMER
+    timer_t timer;
+#endif
+
+    std::vector<std::string> splitLines(const std::string & source)
+    {
+        std::vector<std::string> lines;
+        std::stringstream stream(source);
+        for(std::string line; std::getline(stream, line); ) lines.push_back(line);
+
+        return lines;
+    }
+
+}
+
+
+Sampler::Sampler(const bc::Program &program, std::chrono::microseconds interval)
+    : mProgram(program)
+    , mInterval(interval)
+    , mOffset(program.functions.at(0).entry)
+    , mSamples(bufferSize)
+{
+}
+
+Sampler::~Sampler()
+{
+    if( mRunning ) stop();
+}
+
+void Sampler::start()
+{
+    Sampler * expected = nullptr;
+    if( ! activeSampler.compare_exchange_strong(expected, this) ) {
+
+        throw MissingFeature { "Only one sampler can run at a time" };
+    }
+
+    struct sigaction action {};
+    action.sa_handler = &Sampler::handleSignal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    samplingThread = pthread_self();
+    sigaction(SIGPROF, &action, &previousAction);
+
+    const auto seconds = std::chrono::duration_cast<std::chrono::seconds>(mInterval);
+#if GECKO_THREAD_TIMER
+    // Measures the CPU time of this thread alone, and signals only this thread
+    sigevent event {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = SIGPROF;
+    event.sigev_notify_thread_id = static_cast<pid_t>(syscall(SYS_gettid));
+    if( timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &timer) != 0 ) {
+        sigaction(SIGPROF, &previousAction, nullptr);
+        activeSampler.store(nullptr);
+
+        throw MissingFeature { "Cannot create timer for sampling" };
+    }
+
+    itimerspec period {};
+    period.it_interval.tv_sec = seconds.count();
+    period.it_interval.tv_nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(mInterval - seconds).count();
+    period.it_value = period.it_interval;
+    timer_settime(timer, 0, &period, nullptr);
+#else
+    itimerval timer {};
+    timer.it_interval.tv_sec = seconds.count();
+    timer.it_interval.tv_usec = (mInterval - seconds).count();
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+
+    mRunning = true;
+}
+
+void Sampler::stop()
+{
+#if GECKO_THREAD_TIMER
+    timer_delete(timer);
+#else
+    itimerval timer {};
+    setitimer(ITIMER_PROF, &timer, nullptr);
+#endif
+    sigaction(SIGPROF, &previousAction, nullptr);
+
+    activeSampler.store(nullptr);
+    mRunning = false;
+}
+
+void Sampler::handleSignal(int)
+{
+    // The process wide timer of other platforms may interrupt any thread
+    if( ! pthread_equal(pthread_self(), samplingThread) ) return;
+
+    if( auto sampler = activeSampler.load() ) sampler->sample();
+}
+
+void Sampler::sample()
+{
+    // Runs in the signal handler: no allocation, no locks
+    const auto depth = std::min(mDepth.load(std::memory_order_relaxed), maxDepth);
+    const auto used = mUsed.load(std::memory_order_relaxed);
+    if( used + depth + 2 > mSamples.size() ) {
+        mNumDropped.fetch_add(1, std::memory_order_relaxed);
+
+        return;
+    }
+
+    mSamples[used] = depth + 1;
+    mSamples[used + 1] = mOffset.load(std::memory_order_relaxed);
+    for(size_t i = 0; i < depth; i++) {
+        mSamples[used + 2 + i] = mCalls[depth - 1 - i].load(std::memory_order_relaxed);
+    }
+    mUsed.store(used + depth + 2, std::memory_order_relaxed);
+    mNumSamples.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string Sampler::frame(size_t offset) const
+{
+    return mProgram.functions[mProgram.function(offset)].name + ":" + std::to_string(mProgram.location(offset).line);
+}
+
+void Sampler::reportLines(std::ostream &stream, const std::string &source) const
+{
+    struct Key
+    {
+        int line;
+        std::string function;
+        bool operator<(const Key & other) const { return std::tie(line, function) < std::tie(other.line, other.function); }
+    };
+
+    std::map<Key, size_t> hits;
+    const auto used = mUsed.load();
+    for(size_t i = 0; i < used; i += 1 + mSamples[i]) {
+        const auto offset = mSamples[i + 1];
+        hits[{mProgram.location(offset).line, mProgram.functions[mProgram.function(offset)].name}]++;
+    }
+
+    std::vector<std::pair<Key, size_t> > rows(hits.begin(), hits.end());
+    std::stable_sort(rows.begin(), rows.end(), [](const auto & a, const auto & b) { return a.second > b.second; });
+
+    const auto lines = splitLines(source);
+    const auto total = numSamples();
+
+    // Leave the formatting of stream as it was
+    const auto flags = stream.flags();
+    const auto precision = stream.precision();
+
+    stream << std::setw(10) << "samples" << std::setw(8) << "%" << std::setw(8) << "line" << "  function\n";
+    for(const auto & [key, count] : rows) {
+        stream << std::setw(10) << count
+               << std::setw(8) << std::fixed << std::setprecision(1) << 100.0 * count / total
+               << std::setw(8) << key.line
+               << "  " << key.function;
+        if( key.line > 0 && static_cast<size_t>(key.line) <= lines.size() ) {
+            stream << "  | " << lines[key.line - 1];
+        }
+        stream << "\n";
+    }
+    if( mNumDropped ) stream << mNumDropped << " samples dropped\n";
+
+    stream.flags(flags);
+    stream.precision(precision);
+}
+
+void Sampler::reportFolded(std::ostream &stream) const
+{
+    std::map<std::string, size_t> stacks;
+    const auto used = mUsed.load();
+    for(size_t i = 0; i < used; i += 1 + mSamples[i]) {
+        // Outermost frame first
+        std::string stack;
+        for(size_t j = mSamples[i]; j > 0; j--) {
+            if( ! stack.empty() ) stack += ";";
+            stack += frame(mSamples[i + j]);
+        }
+        stacks[stack]++;
+    }
+
+    for(const auto & [stack, count] : stacks) {
+        stream << stack << " " << count << "\n";
+    }
+}
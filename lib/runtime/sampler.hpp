@@ -0,0 +1,81 @@
+#pragma once
+#include "bytecode.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/// Statistical profiler. A SIGPROF timer periodically interrupts execution
+/// and records the call stack, see run(const bc::Program &, Sampler &).
+/// Only the thread which starts the sampler is sampled, other threads of the process are not interrupted.
+/// Samples are attributed to source lines via bc::Program::locations
+class Sampler
+{
+public:
+
+    explicit Sampler(const bc::Program & program, std::chrono::microseconds interval = std::chrono::microseconds {1000});
+    ~Sampler();
+
+    Sampler(const Sampler &) = delete;
+    Sampler & operator=(const Sampler &) = delete;
+
+    /// Only one sampler can be active at a time
+    void start();
+    void stop();
+
+    /// Called by the interpreter before executing the instruction at offset
+    void enter(size_t offset) { mOffset.store(offset, std::memory_order_relaxed); }
+
+    /// Called by the interpreter with the offset of a call instruction
+    void push(size_t offset)
+    {
+        const auto depth = mDepth.load(std::memory_order_relaxed);
+        if( depth < maxDepth ) mCalls[depth].store(offset, std::memory_order_relaxed);
+        mDepth.store(depth + 1, std::memory_order_relaxed);
+    }
+
+    /// Called by the interpreter on return
+    void pop() { mDepth.store(mDepth.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed); }
+
+    size_t numSamples() const { return mNumSamples; }
+
+    /// Number of samples per source line and function, with the text of the line if source is given
+    void reportLines(std::ostream & stream, const std::string & source = {}) const;
+
+    /// One line per call stack with its number of samples, e.g. "main:3;count:12 42".
+    /// This is the input format of flame graph tools
+    void reportFolded(std::ostream & stream) const;
+
+private:
+
+    static void handleSignal(int);
+    void sample();
+
+    /// Function and line of offset, e.g. "count:12"
+    std::string frame(size_t offset) const;
+
+    /// Deeper calls are cut off in samples
+    static constexpr size_t maxDepth = 64;
+
+    /// Number of words reserved for samples, samples beyond are dropped
+    static constexpr size_t bufferSize = size_t {1} << 20;
+
+    const bc::Program & mProgram;
+    const std::chrono::microseconds mInterval;
+    bool mRunning = false;
+
+    std::atomic<size_t> mOffset;
+    std::atomic<size_t> mDepth {0};
+    std::array<std::atomic<size_t>, maxDepth> mCalls;
+
+    /// Written by the signal handler. Every sample is the number of frames,
+    /// followed by the offsets from the innermost frame outwards
+    std::vector<size_t> mSamples;
+    std::atomic<size_t> mUsed {0};
+    std::atomic<size_t> mNumSamples {0};
+    std::atomic<size_t> mNumDropped {0};
+};
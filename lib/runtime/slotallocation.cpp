@@ -0,0 +1,265 @@
+#include "slotallocation.hpp"
+#include "common/exceptions.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <queue>
+#include <set>
+
+
+namespace bc {
+
+namespace {
+
+    constexpr auto none = std::numeric_limits<size_t>::max();
+
+
+    /// Set of object ids
+    class Bits
+    {
+    public:
+        explicit Bits(size_t size): mWords((size + 63) / 64) {}
+
+        void set(size_t i) { mWords[i / 64] |= uint64_t {1} << (i % 64); }
+        bool contains(size_t i) const { return mWords[i / 64] & ( uint64_t {1} << (i % 64) ); }
+
+        void add(const Bits & other)
+        {
+            for(size_t i = 0; i < mWords.size(); i++) mWords[i] |= other.mWords[i];
+        }
+
+        void remove(const Bits & other)
+        {
+            for(size_t i = 0; i < mWords.size(); i++) mWords[i] &= ~other.mWords[i];
+        }
+
+        template<typename Fn>
+        void forEach(Fn fn) const
+        {
+            for(size_t i = 0; i < mWords.size(); i++) {
+                if( ! mWords[i] ) continue;
+                for(size_t bit = 0; bit < 64; bit++) {
+                    if( mWords[i] & (uint64_t {1} << bit) ) fn(64 * i + bit);
+                }
+            }
+        }
+
+        bool operator!=(const Bits & other) const { return mWords != other.mWords; }
+
+    private:
+        std::vector<uint64_t> mWords;
+    };
+
+
+    /// Instructions of one function with their successors in the control flow graph
+    struct Graph
+    {
+        std::vector<size_t> pcs;
+        std::vector<std::vector<size_t> > successors;
+    };
+
+    Graph controlFlow(const Program & program, size_t function)
+    {
+        Graph graph;
+        const auto entry = program.functions[function].entry;
+        const auto end = program.end(function);
+        const auto & code = program.code;
+
+        std::vector<size_t> indices(end - entry, none);
+        for(size_t pc = entry; pc < end; pc += length(&code[pc])) {
+            indices[pc - entry] = graph.pcs.size();
+            graph.pcs.push_back(pc);
+        }
+
+        const auto n = graph.pcs.size();
+        graph.successors.resize(n);
+        for(size_t i = 0; i < n; i++) {
+            const auto pc = graph.pcs[i];
+            const auto opcode = static_cast<Opcode>(code[pc]);
+            auto & successors = graph.successors[i];
+
+            if( opcode != Jump && opcode != Return && opcode != Halt && i + 1 < n ) {
+                successors.push_back(i + 1);
+            }
+
+            size_t position = pc + 1;
+            for(auto operand : info(opcode).operands) {
+                if( operand == Operand::ReadList || operand == Operand::GlobalList ) {
+                    position += 1 + code[position];
+                    continue;
+                }
+                if( operand == Operand::Target ) {
+                    const auto target = code[position];
+                    if( target < entry || target >= end || indices[target - entry] == none ) {
+
+                        throw CompilerBug { "Jump out of function " + program.functions[function].name };
+                    }
+                    successors.push_back(indices[target - entry]);
+                }
+                position++;
+            }
+        }
+
+        return graph;
+    }
+
+
+    /// New id of every object of the function, 'none' for objects which are never used
+    std::vector<size_t> allocate(Program & program, size_t function, const std::set<Word> & pinned)
+    {
+        const auto & current = program.functions[function];
+        const auto numObjects = current.numObjects;
+        const auto graph = controlFlow(program, function);
+        const auto n = graph.pcs.size();
+
+        std::vector<Bits> uses(n, Bits(numObjects)), defs(n, Bits(numObjects));
+        for(size_t i = 0; i < n; i++) {
+            // Globals are pinned, no need to track them
+            forEachObject(&program.code[graph.pcs[i]], [&](Word & id, Operand operand) {
+                if( operand == Operand::Read ) uses[i].set(id);
+                if( operand == Operand::Write ) defs[i].set(id);
+            });
+        }
+
+        // Backward data flow: live in = uses + (live out - defs)
+        std::vector<Bits> liveIn(n, Bits(numObjects));
+        for(bool changed = true; changed; ) {
+            changed = false;
+            for(size_t i = n; i-- > 0; ) {
+                Bits live(numObjects);
+                for(auto successor : graph.successors[i]) live.add(liveIn[successor]);
+                live.remove(defs[i]);
+                live.add(uses[i]);
+                if( live != liveIn[i] ) {
+                    liveIn[i] = std::move(live);
+                    changed = true;
+                }
+            }
+        }
+
+        // Safepoints neither use nor define objects, whatever is live after them is live before them.
+        // Objects of the main program which functions access have to survive regardless.
+        // Literals live in constant pools, not on the heap
+        std::set<Word> literals;
+        for(const auto & literal : current.literals) literals.insert(literal.first);
+        for(size_t i = 0; i < n; i++) {
+            const auto pc = graph.pcs[i];
+            if( program.code[pc] != Safepoint ) continue;
+
+            auto & objects = program.roots.at(program.code[pc + 1]).objects;
+            objects.erase(std::remove_if(objects.begin(), objects.end(), [&](Word id) {
+                return literals.count(id) || ( ! liveIn[i].contains(id) && ! pinned.count(id) );
+            }), objects.end());
+        }
+
+        // An interval spans every instruction where the object is live or written
+        std::vector<size_t> start(numObjects, none), end(numObjects, 0);
+        const auto extend = [&](size_t id, size_t i) {
+            start[id] = std::min(start[id], i);
+            end[id] = std::max(end[id], i);
+        };
+        for(size_t i = 0; i < n; i++) {
+            liveIn[i].forEach([&](size_t id) { extend(id, i); });
+            defs[i].forEach([&](size_t id) { extend(id, i); });
+        }
+
+        const auto last = n ? n - 1 : 0;
+        for(size_t id = 0; id < current.numArguments; id++) {
+            extend(id, 0);
+        }
+        for(const auto & literal : current.literals) {
+            extend(literal.first, 0);
+            extend(literal.first, last);
+        }
+        for(const auto id : pinned) {
+            extend(id, 0);
+            extend(id, last);
+        }
+
+        std::vector<Word> order;
+        for(Word id = 0; id < numObjects; id++) {
+            if( start[id] != none ) order.push_back(id);
+        }
+        std::sort(order.begin(), order.end(), [&](Word a, Word b) {
+            return std::make_pair(start[a], a) < std::make_pair(start[b], b);
+        });
+
+        // Linear scan. Intervals sharing an instruction never share a slot
+        using Active = std::pair<size_t, Word>; // end, slot
+        std::priority_queue<Active, std::vector<Active>, std::greater<Active> > active;
+        std::set<Word> freeSlots;
+        Word numSlots = current.numArguments; // Arguments keep their slot
+
+        std::vector<size_t> newIds(numObjects, none);
+        for(const auto id : order) {
+            while( ! active.empty() && active.top().first < start[id] ) {
+                freeSlots.insert(active.top().second);
+                active.pop();
+            }
+
+            Word slot;
+            if( id < current.numArguments ) {
+                slot = id;
+            } else if( ! freeSlots.empty() ) {
+                slot = *freeSlots.begin();
+                freeSlots.erase(freeSlots.begin());
+            } else {
+                slot = numSlots++;
+            }
+
+            newIds[id] = slot;
+            active.push({end[id], slot});
+        }
+
+        program.functions[function].numObjects = numSlots;
+
+        return newIds;
+    }
+
+}
+
+
+void allocateSlots(Program &program)
+{
+    if( program.functions.empty() ) return;
+
+    // Functions may access objects of the main program at any time
+    std::set<Word> globals;
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        for(size_t pc = program.functions[i].entry; pc < program.end(i); pc += length(&program.code[pc])) {
+            forEachObject(&program.code[pc], [&](Word & id, Operand operand) {
+                if( operand == Operand::Global ) globals.insert(id);
+            });
+        }
+    }
+
+    std::vector<size_t> globalIds;
+    for(size_t i = 0; i < program.functions.size(); i++) {
+        const auto newIds = allocate(program, i, i == 0 ? globals : std::set<Word> {});
+        if( i == 0 ) globalIds = newIds;
+
+        for(size_t pc = program.functions[i].entry; pc < program.end(i); pc += length(&program.code[pc])) {
+            forEachObject(&program.code[pc], [&](Word & id, Operand operand) {
+                id = ( operand == Operand::Global ? globalIds : newIds ).at(id);
+            });
+
+            if( program.code[pc] == Safepoint ) {
+                // Only globals which functions access can point to objects allocated by functions
+                auto & roots = program.roots.at(program.code[pc + 1]);
+                for(auto & id : roots.objects) id = newIds.at(id);
+                roots.globals.erase(std::remove_if(roots.globals.begin(), roots.globals.end(), [&](Word id) {
+                    return ! globals.count(id);
+                }), roots.globals.end());
+                for(auto & id : roots.globals) id = globalIds.at(id);
+            }
+        }
+
+        for(auto & literal : program.functions[i].literals) {
+            literal.first = newIds.at(literal.first);
+        }
+    }
+}
+
+
+} // namespace bc
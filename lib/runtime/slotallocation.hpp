@@ -0,0 +1,17 @@
+#pragma once
+#include "bytecode.hpp"
+
+
+namespace bc {
+
+
+/// Let objects share a slot of the frame if their lifetimes do not overlap.
+///
+/// Liveness is computed per function over the control flow graph of its bytecode,
+/// slots are then assigned by a linear scan over the live intervals.
+/// Arguments keep their ids. Literals and globals occupy their slot for the whole function.
+/// Roots of safepoints are reduced to the objects which are live there, see ins::Safepoint.
+void allocateSlots(Program & program);
+
+
+} // namespace bc
@@ -0,0 +1,56 @@
+#include "workerpool.hpp"
+
+
+WorkerPool::WorkerPool(size_t numWorkers)
+{
+    for(size_t i = 1; i < numWorkers; i++) {
+        mThreads.emplace_back([this, i] { work(i); });
+    }
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStop = true;
+    }
+    mStart.notify_all();
+    for(auto & thread : mThreads) thread.join();
+}
+
+void WorkerPool::run(const std::function<void(size_t)> & job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJob = &job;
+        mGeneration++;
+        mRunning = mThreads.size();
+    }
+    mStart.notify_all();
+
+    job(0);
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    mDone.wait(lock, [this] { return mRunning == 0; });
+    mJob = nullptr;
+}
+
+void WorkerPool::work(size_t index)
+{
+    size_t generation = 0;
+    for(;;) {
+        const std::function<void(size_t)> * job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mStart.wait(lock, [&] { return mStop || mGeneration != generation; });
+            if( mStop ) return;
+            generation = mGeneration;
+            job = mJob;
+        }
+
+        (*job)(index);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        if( --mRunning == 0 ) mDone.notify_one();
+    }
+}
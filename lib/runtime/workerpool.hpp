@@ -0,0 +1,48 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/// Threads which run the same job side by side, see run.
+///
+/// Workers sleep between jobs, s.t. one pool serves every collection of a MemoryManager.
+/// The calling thread takes part in every job as the worker with index 0
+class WorkerPool
+{
+public:
+
+    /// numWorkers includes the calling thread
+    explicit WorkerPool(size_t numWorkers);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool & operator=(const WorkerPool &) = delete;
+
+    size_t size() const { return mThreads.size() + 1; }
+
+    /// Call job(index) for every index from 0 up to size() on its own worker and wait until all calls have returned.
+    /// job must not throw
+    void run(const std::function<void(size_t)> & job);
+
+private:
+
+    void work(size_t index);
+
+    std::vector<std::thread> mThreads;
+
+    std::mutex mMutex;
+    std::condition_variable mStart;
+    std::condition_variable mDone;
+
+    const std::function<void(size_t)> * mJob = nullptr;
+
+    /// Counts the jobs, s.t. a worker runs every job once
+    size_t mGeneration = 0;
+
+    /// Workers besides the calling thread which have yet to finish the current job
+    size_t mRunning = 0;
+    bool mStop = false;
+};
@@ -99,6 +99,11 @@ std::shared_ptr<State> StateInitial::handle(Iterator &it, std::vector<Token> & t
         advance(it, position);
         return std::make_shared<StateInitial>();
     }
+    if( c == '.' ) {
+        *tokens.rbegin() = {Token::Range, ".", position};
+        advance(it, position);
+        return std::make_shared<StateRange>();
+    }
 
     if( c == '\n' ) {
         *tokens.rbegin() = {Token::LineBreak, "<linebreak>", position};
@@ -149,8 +154,21 @@ std::shared_ptr<State> StateNumericLiteral::handle(Iterator &it, std::vector<Tok
     const auto c = *it;
 
     if( c == '.' ) {
-        tokens.rbegin()->type = Token::FloatLiteral;
-        tokens.rbegin()->value += c;
+        auto & literal = *tokens.rbegin();
+        if( literal.type == Token::FloatLiteral && literal.value.back() == '.' ) {
+            // Integer followed by the range operator, as in 0..n
+            literal.type = Token::IntLiteral;
+            literal.value.pop_back();
+            auto start = position;
+            start.column--;
+            tokens.push_back({Token::Range, "..", start});
+            advance(it, position);
+
+            return std::make_shared<StateInitial>();
+        }
+
+        literal.type = Token::FloatLiteral;
+        literal.value += c;
         advance(it, position);
 
         return std::make_shared<StateNumericLiteral>();
@@ -167,6 +185,17 @@ std::shared_ptr<State> StateNumericLiteral::handle(Iterator &it, std::vector<Tok
     return std::make_shared<StateInitial>();
 }
 
+std::shared_ptr<State> StateRange::handle(State::Iterator &it, std::vector<Token> &tokens, Position &position)
+{
+    const auto c = *it;
+    if( c != '.' ) throw UnexpectedCharacter(position, c);
+
+    tokens.rbegin()->value += c;
+    advance(it, position);
+
+    return std::make_shared<StateInitial>();
+}
+
 std::shared_ptr<State> StateStringLiteral::handle(State::Iterator &it, std::vector<Token> &tokens, Position &position)
 {
     const auto c = *it;
@@ -218,7 +247,7 @@ std::shared_ptr<State> StateIndent::handle(State::Iterator &it, std::vector<Toke
     return std::make_shared<StateInitial>();
 }
 
-std::shared_ptr<State> StateComment::handle(State::Iterator &it, std::vector<Token> &tokens, Position &position)
+std::shared_ptr<State> StateComment::handle(State::Iterator &it, std::vector<Token> & /* tokens */, Position &position)
 {
     if( *it == '\n') {
         return std::make_shared<StateInitial>();
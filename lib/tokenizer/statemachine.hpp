@@ -33,6 +33,14 @@ class StateNumericLiteral: public State
 };
 
 
+/// Second dot of the range operator '..'
+class StateRange: public State
+{
+    const char * name() const override { return "range"; }
+    std::shared_ptr<State> handle(Iterator & it, std::vector<Token> & tokens, Position & position) override;
+};
+
+
 class StateStringLiteral: public State
 {
     const char * name() const override { return "string_literal"; }
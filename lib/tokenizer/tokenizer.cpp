@@ -84,6 +84,7 @@ const std::string & tokenName(Token::Type tokenType) {
         {Token::ParenLeft, "ParenLeft"},
         {Token::ParenRight, "ParenRight"},
         {Token::Plus, "Plus"},
+        {Token::Range, "Range"},
         {Token::StringLiteral, "StringLiteral"},
         {Token::Struct, "Struct"},
         {Token::Switch, "Switch"},
@@ -32,6 +32,8 @@ struct Token
         GreaterThan,
         GTE,
 
+        Range,
+
         // TODO: (bitwise) and / or
         // TODO: unary operators
 
@@ -4,6 +4,7 @@
 #include "runtime/executor.hpp"
 
 #include <iostream>
+#include <set>
 
 #define BOOST_TEST_MAIN
 #if !defined( WIN32 )
@@ -106,7 +107,7 @@ BOOST_AUTO_TEST_CASE(test_compiler)
     std::cout << "BEGIN Output of executed program: \n";
     ct::Compiler compiler;
     program.acceptVisitor(compiler);
-    run(compiler.instructions(), compiler.numObjectIdsUsed());
+    run(compiler.mainFunction());
     std::cout << "END\n";
 
 }
@@ -137,3 +138,94 @@ BOOST_AUTO_TEST_CASE(test_out_of_scope)
     BOOST_CHECK_THROW(program->acceptVisitor(compiler), UndefinedVariable);
 }
 
+
+BOOST_AUTO_TEST_CASE(test_bytecode)
+{
+    using namespace ast;
+
+    auto loopBody = std::make_unique<Scope>(dummyPosition);
+    loopBody->addStatement(std::make_unique<Assignment>(
+                               std::make_unique<Name>("x", dummyPosition),
+                               std::make_unique<IntLiteral>(1, dummyPosition))
+                          );
+    auto program = std::make_unique<Scope>(dummyPosition);
+    program->addStatement(std::make_unique<While>(
+                           std::make_unique<BooleanLiteral>(false, dummyPosition),
+                           std::move(loopBody), dummyPosition));
+
+    ct::Compiler compiler;
+    program->acceptVisitor(compiler);
+    const auto bytecode = compiler.program();
+
+    // Walk instruction by instruction, all jumps must land on an instruction
+    const auto & code = bytecode.code;
+    std::set<size_t> starts, targets;
+    for(size_t pc = 0; pc < code.size(); pc += bc::length(&code[pc])) {
+        starts.insert(pc);
+        const auto & operands = bc::info(static_cast<bc::Opcode>(code[pc])).operands;
+        for(size_t i = 0; i < operands.size(); i++) {
+            if( operands[i] == bc::Operand::Target ) targets.insert(code[pc + 1 + i]);
+        }
+    }
+    BOOST_CHECK_EQUAL(code.back(), bc::Halt);
+    BOOST_CHECK_EQUAL(targets.size(), 2);
+    for(auto target : targets) BOOST_CHECK(starts.count(target));
+
+    run(bytecode);
+}
+
+BOOST_AUTO_TEST_CASE(test_literals_are_shared)
+{
+    using namespace ast;
+
+    Scope program(dummyPosition);
+    for(const auto name : {"x", "y"}) {
+        program.addStatement(std::make_unique<Assignment>(
+                                 std::make_unique<Name>(name, dummyPosition),
+                                 std::make_unique<IntLiteral>(1, dummyPosition))
+                             );
+    }
+    for(const auto name : {"s", "t"}) {
+        program.addStatement(std::make_unique<Assignment>(
+                                 std::make_unique<Name>(name, dummyPosition),
+                                 std::make_unique<StringLiteral>("text", dummyPosition))
+                             );
+    }
+
+    ct::Compiler compiler;
+    program.acceptVisitor(compiler);
+
+    // One object per distinct literal
+    BOOST_CHECK_EQUAL(compiler.constants().values().size(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(test_slots_are_shared)
+{
+    using namespace ast;
+
+    // Every addition creates a temporary which is dead after the assignment
+    Scope program(dummyPosition);
+    for(const auto name : {"x", "y", "z"}) {
+        program.addStatement(std::make_unique<Assignment>(
+                                 std::make_unique<Name>(name, dummyPosition),
+                                 std::make_unique<IntLiteral>(1, dummyPosition))
+                             );
+    }
+    for(int i = 0; i < 10; i++) {
+        auto funCall = std::make_unique<FunctionCall>(
+            std::make_unique<Name>("print", dummyPosition), nullptr
+        );
+        funCall->addArgument(std::make_unique<Addition>(
+                                std::make_unique<Name>("x", dummyPosition),
+                                std::make_unique<Name>("y", dummyPosition)
+                            ));
+        program.addStatement(std::move(funCall));
+    }
+
+    ct::Compiler compiler;
+    program.acceptVisitor(compiler);
+    const auto bytecode = compiler.program();
+
+    BOOST_CHECK_GT(compiler.numObjectIdsUsed(), 20);
+    BOOST_CHECK_LT(bytecode.functions.at(0).numObjects, 6);
+}
@@ -10,12 +10,16 @@
 #include "parser/ast.hpp"
 #include "parser/parser.hpp"
 #include "runtime/executor.hpp"
-#include "runtime/output.hpp"
+#include "runtime/heapstatistics.hpp"
+#include "runtime/profiler.hpp"
+#include "runtime/sampler.hpp"
 
+#include <algorithm>
 #include <sstream>
 
 
-std::string eval(const std::string & code)
+std::unique_ptr<ct::Compiler> compile(const std::string & code,
+                                      ct::Compiler::GarbageCollection collection = ct::Compiler::GarbageCollection::Explicit)
 {
     Tokenizer tokenizer;
     const auto tokens = tokenizer.tokenize(code);
@@ -24,12 +28,24 @@ std::string eval(const std::string & code)
     const auto end = tokens.cend();
     const auto ast = parseScope(it, end, 0);
 
-    ct::Compiler compiler;
-    ast->acceptVisitor(compiler);
+    auto compiler = std::make_unique<ct::Compiler>(collection);
+    ast->acceptVisitor(*compiler);
+
+    return compiler;
+}
+
+
+std::string eval(const std::string & code)
+{
+    const auto compiler = compile(code);
 
     std::stringstream stream;
-    getOutput().stdout = &stream;
-    run(compiler.instructions(), compiler.numObjectIdsUsed());
+    Executor(std::cin, stream).run(compiler->program());
+
+    // Instruction objects serve as reference for the bytecode interpreter
+    std::stringstream reference;
+    Executor(std::cin, reference).run(compiler->mainFunction());
+    BOOST_CHECK_EQUAL(stream.str(), reference.str());
 
     return stream.str();
 }
@@ -135,6 +151,35 @@ print(15)
 }
 
 
+BOOST_AUTO_TEST_CASE(function_frames)
+{
+    // Loops, globals and calls from within functions
+    const auto code = R"###(
+total = 0
+
+function add(a: Int, b: Int)
+    a + b
+
+function count(n: Int)
+    i = 0
+    while i < n
+        total = add(total, 1)
+        i = i + 1
+    i
+
+function twice(total: Int)
+    count(total) + count(total)
+
+print(twice(3))
+print(total)
+print(add(count(2), 1))
+print(total)
+)###";
+
+    BOOST_CHECK_EQUAL(eval(code), "6\n6\n3\n8\n");
+}
+
+
 BOOST_AUTO_TEST_CASE(typed_list)
 {
     const auto code = R"###(
@@ -148,3 +193,404 @@ print(length(list))
 }
 
 
+
+
+BOOST_AUTO_TEST_CASE(fused_comparisons)
+{
+    const auto code = R"###(
+i = 0
+while i < 4
+    if i > 1
+        print(i)
+    if 2 > i
+        print(10 + i)
+    i = 1 + i
+)###";
+
+    BOOST_CHECK_EQUAL(eval(code), "10\n11\n2\n3\n");
+}
+
+
+BOOST_AUTO_TEST_CASE(counting_loops)
+{
+    const auto code = R"###(
+function sum(n: Int)
+    total = 0
+    for i in 0..n
+        total = total + i
+    total
+
+print(sum(10))
+for i in 2..11 by 3
+    print(i)
+for i in 5..5
+    print(i)
+n = 2
+for i in 0..n
+    n = 0
+    i = i + 100
+    print(i)
+)###";
+
+    BOOST_CHECK_EQUAL(eval(code), "45\n2\n5\n8\n100\n101\n");
+
+    // Stops instead of wrapping around
+    BOOST_CHECK_EQUAL(eval("for i in 9223372036854775805..9223372036854775807 by 2\n    print(i)\n"),
+                      "9223372036854775805\n");
+
+    // Steps which are not positive never reach the end
+    BOOST_CHECK_THROW(compile("for i in 0..5 by 0\n    print(i)\n"), InvalidStep);
+
+    const auto computed = compile("s = 0\nfor i in 0..5 by s\n    print(i)\n");
+    std::stringstream output;
+    BOOST_CHECK_THROW(Executor(std::cin, output).run(computed->program()), InvalidStep);
+    BOOST_CHECK_THROW(Executor(std::cin, output).run(computed->mainFunction()), InvalidStep);
+    BOOST_CHECK_EQUAL(output.str(), "");
+}
+
+
+BOOST_AUTO_TEST_CASE(profiler)
+{
+    const auto code = R"###(
+i = 0
+while i < 3
+    print(i)
+    i = i + 1
+)###";
+
+    const auto program = compile(code)->program();
+
+    std::stringstream output;
+    Profiler profiler(program);
+    Executor(std::cin, output).run(program, profiler);
+    BOOST_CHECK_EQUAL(output.str(), "0\n1\n2\n");
+
+    uint64_t numPrints = 0;
+    for(size_t pc = 0; pc < program.code.size(); pc += bc::length(&program.code[pc])) {
+        if( program.code[pc] == bc::PrintInt ) numPrints += profiler.count(pc);
+    }
+    BOOST_CHECK_EQUAL(numPrints, 3);
+
+    // Hot instructions are shown as disassembled by Instruction::toString
+    std::stringstream report;
+    profiler.report(report);
+    BOOST_CHECK_NE(report.str().find(": PrintInt"), std::string::npos);
+}
+
+
+BOOST_AUTO_TEST_CASE(sampler)
+{
+    const auto code = R"###(
+function count(n: Int)
+    i = 0
+    while i < n
+        i = i + 1
+    i
+
+print(count(1000000))
+)###";
+
+    const auto program = compile(code)->program();
+
+    std::stringstream output;
+    Sampler sampler(program, std::chrono::microseconds {100});
+    Executor(std::cin, output).run(program, sampler);
+    BOOST_CHECK_EQUAL(output.str(), "1000000\n");
+    BOOST_REQUIRE_GT(sampler.numSamples(), 0);
+
+    // Samples are taken in the loop of count, called from line 8
+    std::stringstream folded;
+    sampler.reportFolded(folded);
+    for(std::string line; std::getline(folded, line); ) {
+        BOOST_CHECK_EQUAL(line.substr(0, 13), "main:8;count:");
+        const auto countLine = line.substr(13, 1);
+        BOOST_CHECK(countLine == "3" || countLine == "4" || countLine == "5");
+    }
+
+    // The report leaves the formatting of its stream alone
+    std::stringstream lines;
+    const auto flags = lines.flags();
+    const auto precision = lines.precision();
+    sampler.reportLines(lines, code);
+    BOOST_CHECK(lines.flags() == flags);
+    BOOST_CHECK_EQUAL(lines.precision(), precision);
+}
+
+
+BOOST_AUTO_TEST_CASE(heap_statistics)
+{
+    const auto code = R"###(
+lines = List<String>()
+for line in stdin
+    append(lines, line)
+    free
+print(length(lines))
+)###";
+
+    const auto program = compile(code)->program();
+
+    std::string input;
+    for(int i = 0; i < 100; i++) input += "line " + std::to_string(i) + "\n";
+    std::stringstream stream(input), output;
+    Executor executor(stream, output);
+    HeapStatistics statistics(&program);
+    executor.run(program, statistics);
+    BOOST_CHECK_EQUAL(output.str(), "101\n");
+    BOOST_CHECK_GE(statistics.numCollections(), 101);
+    BOOST_CHECK_EQUAL(statistics.pauses(HeapStatistics::Pause::Nursery).count, statistics.numCollections());
+
+    // Every line is read into a string, and the loop allocates nothing else
+    uint64_t numRead = 0;
+    for(size_t pc = 0; pc < program.code.size(); pc += bc::length(&program.code[pc])) {
+        if( program.code[pc] == bc::ReadLine ) numRead += statistics.site(pc).objects;
+    }
+    BOOST_CHECK_EQUAL(numRead, 101);
+    BOOST_CHECK_EQUAL(statistics.types().at(obj::STRING).objects, 101);
+    // Besides, only the list and the object standing for stdin
+    uint64_t numAllocated = 0;
+    for(const auto & count : statistics.types()) numAllocated += count.objects;
+    BOOST_CHECK_EQUAL(numAllocated, 103);
+    BOOST_CHECK_EQUAL(statistics.reclaimedBytes(), 0);
+
+    const auto held = executor.memory().census();
+    BOOST_CHECK_EQUAL(held.at(obj::STRING).objects, 101);
+
+    std::stringstream json;
+    statistics.writeJson(json, held);
+    BOOST_CHECK_NE(json.str().find("\"name\": \"String\", \"allocated_objects\": 101"), std::string::npos);
+    BOOST_CHECK_NE(json.str().find("\"opcode\": \"ReadLine\""), std::string::npos);
+}
+
+
+BOOST_AUTO_TEST_CASE(output_comes_before_runtime_errors)
+{
+    const auto code = R"###(
+print(1)
+l = List<Int>()
+s = length(l)
+for i in 1..5 by s
+    print(i)
+)###";
+
+    const auto compiler = compile(code);
+    for(const auto reference : {false, true}) {
+        std::stringstream output;
+        Executor executor(std::cin, output);
+        try {
+            if( reference ) {
+                executor.run(compiler->mainFunction());
+            } else {
+                executor.run(compiler->program());
+            }
+            BOOST_ERROR("Expected InvalidStep");
+        } catch(const InvalidStep &) {
+            // Written while the executor is still alive
+            BOOST_CHECK_EQUAL(output.str(), "1\n");
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(executor_runs_program_many_times)
+{
+    const auto code = R"###(
+n = 0
+for line in stdin
+    print(line)
+    n = n + 1
+print(n)
+)###";
+
+    const auto program = compile(code)->program();
+
+    std::stringstream output;
+    Executor executor(std::cin, output);
+    for(const std::string input : {"a\nb", "c"}) {
+        std::stringstream stream(input);
+        executor.setInput(stream);
+        output.str("");
+        executor.run(program);
+        BOOST_CHECK_EQUAL(output.str(), input + "\n" + std::to_string(std::count(input.begin(), input.end(), '\n') + 1) + "\n");
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(automatic_collection_bounds_memory)
+{
+    const auto code = R"###(
+function build(n: Int)
+    list = List<Int>()
+    append(list, n)
+    list
+
+kept = List<String>()
+i = 0
+while i < 100000
+    garbage = build(i)
+    append(kept, "x")
+    i = i + 1
+print(length(kept))
+)###";
+
+    std::stringstream output;
+    Executor explicitExecutor(std::cin, output);
+    explicitExecutor.run(compile(code)->program());
+
+    const auto compiler = compile(code, ct::Compiler::GarbageCollection::Automatic);
+    Executor executor(std::cin, output);
+    executor.run(compiler->program());
+    BOOST_CHECK_EQUAL(output.str(), "100000\n100000\n");
+    BOOST_CHECK_LT(4 * executor.memory().reserved(), explicitExecutor.memory().reserved());
+
+    // Safepoints keep the lists and the counter, but not the garbage of the previous iteration
+    const auto program = compiler->program();
+    for(size_t pc = 0; pc < program.end(0); pc += bc::length(&program.code[pc])) {
+        if( program.code[pc] == bc::Safepoint ) {
+            BOOST_CHECK_EQUAL(program.roots.at(program.code[pc + 1]).objects.size(), 1);
+        }
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(compaction_keeps_literals)
+{
+    const auto code = R"###(
+function build(n: Int)
+    list = List<Int>()
+    append(list, n)
+    list
+
+keep = List<String>()
+i = 0
+while i < 20000
+    garbage = build(i)
+    append(keep, "k")
+    i = i + 1
+free
+print(length(keep))
+)###";
+
+    std::stringstream output;
+    Executor executor(std::cin, output);
+    executor.memory().setCompaction(true);
+    executor.run(compile(code)->program());
+    BOOST_CHECK_EQUAL(output.str(), "20000\n");
+}
+
+
+BOOST_AUTO_TEST_CASE(compaction_after_dropping_remembered_lists)
+{
+    // Every list is written to after it has left the nursery, and dies in the next iteration
+    const auto code = R"###(
+outer = List<String>()
+for line in stdin
+    outer = List<String>()
+    free
+    append(outer, line)
+print(length(outer))
+)###";
+
+    std::string input;
+    for(int i = 0; i < 20000; i++) input += std::to_string(i) + "\n";
+    std::stringstream stream(input);
+
+    std::stringstream output;
+    Executor executor(std::cin, output);
+    executor.memory().setCompaction(true);
+    executor.setInput(stream);
+    executor.run(compile(code)->program());
+    BOOST_CHECK_EQUAL(output.str(), "1\n");
+}
+
+
+BOOST_AUTO_TEST_CASE(functions_delete_their_objects)
+{
+    // Neither function lets its list escape, so only the returned list survives without any free
+    const auto code = R"###(
+function count(n: Int)
+    list = List<Int>()
+    i = 0
+    while i < n
+        append(list, i)
+        i = i + 1
+    length(list)
+
+function single(n: Int)
+    list = List<Int>()
+    append(list, n)
+    list
+
+kept = single(7)
+total = 0
+i = 0
+while i < 1000
+    total = total + count(3)
+    i = i + 1
+print(total)
+print(length(kept))
+)###";
+
+    const auto compiler = compile(code);
+    for(const auto reference : {false, true}) {
+        std::stringstream output;
+        Executor executor(std::cin, output);
+        if( reference ) {
+            executor.run(compiler->mainFunction());
+        } else {
+            executor.run(compiler->program());
+        }
+        BOOST_CHECK_EQUAL(output.str(), "3000\n1\n");
+        BOOST_CHECK_EQUAL(executor.memory().census().at(obj::LIST_OF_SIMPLE).objects, 1);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(safepoints_keep_live_objects)
+{
+    const auto code = R"###(
+function lines()
+    all = List<String>()
+    for line in stdin
+        append(all, line)
+    all
+
+list = lines()
+latest = List<Int>()
+total = 0
+
+function store(n: Int)
+    latest = List<Int>()
+    i = 0
+    while i < 3
+        append(latest, n)
+        i = i + 1
+    length(list)
+
+i = 0
+while i < 1000
+    total = store(i)
+    i = i + 1
+print(total)
+print(length(latest))
+)###";
+
+    std::string input;
+    for(int i = 0; i < 10000; i++) input += "line " + std::to_string(i) + "\n";
+
+    // Collect the arena at once and incrementally
+    const auto compiler = compile(code, ct::Compiler::GarbageCollection::Automatic);
+    for(const auto budget : {MemoryManager::SliceBudget {}, MemoryManager::SliceBudget {10}}) {
+        for(const auto reference : {false, true}) {
+            std::stringstream stream(input), output;
+            Executor executor(stream, output);
+            executor.memory().setGrowthThreshold(1024);
+            executor.memory().setSliceBudget(budget);
+            if( reference ) {
+                executor.run(compiler->mainFunction());
+            } else {
+                executor.run(compiler->program());
+            }
+            BOOST_CHECK_EQUAL(output.str(), "10001\n3\n");
+        }
+    }
+}
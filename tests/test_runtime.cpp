@@ -0,0 +1,538 @@
+#define BOOST_TEST_MAIN
+#if !defined( WIN32 )
+    #define BOOST_TEST_DYN_LINK
+#endif
+#include <boost/test/unit_test.hpp>
+
+
+#include "runtime/arena.hpp"
+#include "runtime/constantpool.hpp"
+#include "runtime/linereader.hpp"
+#include "runtime/memorymanager.hpp"
+#include "runtime/outputwriter.hpp"
+#include "runtime/objects/list.hpp"
+#include "runtime/objects/string.hpp"
+#include "runtime/objects/tuple.hpp"
+
+#include <atomic>
+#include <sstream>
+
+
+namespace {
+
+    /// Counts instances s.t. tests can observe deletion, also by the threads of a parallel collection
+    class Counted: public obj::Allocated
+    {
+    public:
+        Counted(): Allocated(type()) { instances++; }
+        Counted(const Counted & other): Allocated(other) { instances++; }
+        ~Counted() { instances--; }
+
+        static obj::TypeIndex type()
+        {
+            static const auto ret = obj::registerType({
+                "Counted", sizeof(Counted), {}, false, &obj::destroyAs<Counted>, &obj::relocateAs<Counted>
+            });
+
+            return ret;
+        }
+
+        static std::atomic<int> instances;
+    };
+
+    std::atomic<int> Counted::instances {0};
+
+    obj::List * newList(MemoryManager & memory)
+    {
+        return memory.make<obj::List>(true);
+    }
+
+    void append(obj::List * list, obj::Allocated * item)
+    {
+        Object object;
+        object.as_ptr = item;
+        list->mItems.push_back(object);
+    }
+
+}
+
+
+BOOST_AUTO_TEST_CASE(unreachable_objects_are_deleted)
+{
+    MemoryManager memory;
+    obj::Allocated * list = newList(memory);
+    append(static_cast<obj::List *>(list), memory.make<Counted>());
+    memory.make<Counted>();
+    BOOST_CHECK_EQUAL(Counted::instances, 2);
+
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(list);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1);
+
+    // Marks of the previous collection do not keep anything alive
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(survivors_leave_the_nursery)
+{
+    MemoryManager memory;
+    obj::Allocated * list = newList(memory);
+    const auto item = memory.make<Counted>();
+    append(static_cast<obj::List *>(list), item);
+    memory.make<Counted>();
+    BOOST_CHECK(memory.isYoung(list));
+
+    // The root is updated to the new location, pointers within moved objects as well
+    memory.beginCollection();
+    memory.mark(list);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1);
+    BOOST_CHECK( ! memory.isYoung(list));
+    const auto moved = static_cast<obj::List *>(list)->mItems.at(0).as_ptr;
+    BOOST_CHECK( ! memory.isYoung(moved));
+    BOOST_CHECK_NE(moved, item);
+
+    // Old objects are remembered when they point to young ones
+    append(static_cast<obj::List *>(list), memory.make<Counted>());
+    memory.writeBarrier(list);
+    memory.beginCollection();
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 2);
+    BOOST_CHECK( ! memory.isYoung(static_cast<obj::List *>(list)->mItems.at(1).as_ptr));
+
+    // Old objects are only collected by full collections
+    memory.beginCollection();
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 2);
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(objects_before_barrier_survive)
+{
+    MemoryManager memory;
+    obj::Allocated * list = newList(memory);
+    memory.push();
+
+    // Reachable from the young list before the barrier, which is not a root
+    append(static_cast<obj::List *>(list), memory.make<Counted>());
+    memory.make<Counted>();
+
+    memory.beginCollection();
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1);
+    BOOST_CHECK(memory.isYoung(list));
+
+    memory.pop();
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(regions_keep_only_the_result)
+{
+    MemoryManager memory;
+    obj::Allocated * before = memory.make<Counted>();
+    memory.push();
+
+    obj::Allocated * list = newList(memory);
+    append(static_cast<obj::List *>(list), memory.make<Counted>());
+    obj::Allocated * old = memory.make<Counted>();
+
+    // Moves the list, its item and the garbage to the arena
+    memory.beginCollection();
+    memory.mark(list);
+    memory.mark(old);
+    memory.collectGarbage();
+    BOOST_CHECK( ! memory.isYoung(old));
+
+    append(static_cast<obj::List *>(list), memory.make<Counted>());
+    append(static_cast<obj::List *>(list), before);
+    memory.writeBarrier(list);
+    memory.make<Counted>();
+    BOOST_CHECK_EQUAL(Counted::instances, 5);
+
+    // Young and old garbage goes, the young item moves to the arena, objects before the barrier stay
+    memory.popRegion(&list);
+    BOOST_CHECK_EQUAL(Counted::instances, 3);
+    const auto & items = static_cast<obj::List *>(list)->mItems;
+    BOOST_CHECK( ! memory.isYoung(items.at(1).as_ptr));
+    BOOST_CHECK_EQUAL(items.at(2).as_ptr, before);
+    BOOST_CHECK(memory.isYoung(before));
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(incremental_collection_spreads_work)
+{
+    MemoryManager memory;
+    memory.setSliceBudget({100});
+    obj::Allocated * root = newList(memory);
+    for(int i = 0; i < 2000; i++) append(static_cast<obj::List *>(root), memory.make<Counted>());
+
+    // Move everything into the arena, then drop half of it
+    memory.beginCollection();
+    memory.mark(root);
+    memory.collectGarbage();
+    static_cast<obj::List *>(root)->mItems.resize(1000);
+
+    int numCollections = 0;
+    while( Counted::instances > 1000 && numCollections < 1000 ) {
+        memory.beginCollection();
+        memory.mark(root);
+        memory.collectGarbage();
+        numCollections++;
+        BOOST_REQUIRE_GE(Counted::instances, 1000);
+    }
+    BOOST_CHECK_EQUAL(Counted::instances, 1000);
+    BOOST_CHECK_GT(numCollections, 10);
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(write_barrier_keeps_objects_moved_while_marking)
+{
+    MemoryManager memory;
+    memory.setSliceBudget({1});
+    obj::Allocated * root = newList(memory);
+    const auto fillers = newList(memory);
+    for(int i = 0; i < 1100; i++) append(fillers, memory.make<Counted>());
+    const auto before = newList(memory);
+    append(before, memory.make<Counted>());
+    for(auto child : {fillers, before, newList(memory)}) append(static_cast<obj::List *>(root), child);
+
+    // Lists have moved into the arena
+    memory.beginCollection();
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_REQUIRE_EQUAL(Counted::instances, 1101);
+    const auto & children = static_cast<obj::List *>(root)->mItems;
+    const auto from = static_cast<obj::List *>(children[1].as_ptr);
+    const auto to = static_cast<obj::List *>(children[2].as_ptr);
+
+    // The first slice marks the root, the second one the last list
+    for(int i = 0; i < 2; i++) {
+        memory.beginCollection();
+        memory.mark(root);
+        memory.collectGarbage();
+    }
+
+    // Only the list which has been marked already refers to the object now
+    const auto object = from->mItems.back().as_ptr;
+    from->mItems.clear();
+    append(to, object);
+    memory.writeBarrier(to);
+
+    for(int i = 0; i < 5000; i++) {
+        memory.beginCollection();
+        memory.mark(root);
+        memory.collectGarbage();
+    }
+    BOOST_CHECK_EQUAL(Counted::instances, 1101);
+
+    // Unreachable once the incremental collection has come around again
+    to->mItems.clear();
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1100);
+
+    memory.clear();
+}
+
+
+BOOST_AUTO_TEST_CASE(parallel_collection_keeps_reachable_objects)
+{
+    MemoryManager memory;
+    memory.setCollectorThreads(4);
+    obj::Allocated * root = newList(memory);
+    for(int i = 0; i < 50000; i++) {
+        const auto pair = newList(memory);
+        append(pair, memory.make<Counted>());
+        append(pair, memory.make<Counted>());
+        memory.writeBarrier(pair);
+        append(static_cast<obj::List *>(root), pair);
+    }
+
+    // Marking a chain cannot be shared, it must be done nonetheless
+    auto chain = newList(memory);
+    append(static_cast<obj::List *>(root), chain);
+    for(int i = 0; i < 20000; i++) {
+        const auto next = newList(memory);
+        append(next, memory.make<Counted>());
+        memory.writeBarrier(next);
+        append(chain, next);
+        memory.writeBarrier(chain);
+        chain = next;
+    }
+    BOOST_REQUIRE_EQUAL(Counted::instances, 120000);
+
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 120000);
+
+    // Drop the chain and half of the pairs
+    static_cast<obj::List *>(root)->mItems.resize(25000);
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 50000);
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(dead_remembered_objects_keep_nothing_alive)
+{
+    // Enough objects to mark on several threads, if there are any
+    for(const size_t numThreads : {1, 4}) {
+        MemoryManager memory;
+        memory.setCollectorThreads(numThreads);
+        obj::Allocated * root = newList(memory);
+        const auto live = newList(memory);
+        const auto dead = newList(memory);
+        append(static_cast<obj::List *>(root), live);
+        append(static_cast<obj::List *>(root), dead);
+        for(int i = 0; i < 70000; i++) append(static_cast<obj::List *>(root), memory.make<Counted>());
+        for(auto list : {live, dead}) append(list, memory.make<Counted>());
+        memory.beginCollection(MemoryManager::Collection::Full);
+        memory.mark(root);
+        memory.collectGarbage();
+
+        // Both lists are old and remembered, and point to an old and a young object
+        auto & items = static_cast<obj::List *>(root)->mItems;
+        for(size_t i = 0; i < 2; i++) {
+            const auto list = static_cast<obj::List *>(items[i].as_ptr);
+            append(list, memory.make<Counted>());
+            memory.writeBarrier(list);
+        }
+        BOOST_REQUIRE_EQUAL(Counted::instances, 70004);
+
+        // Only the live list is reachable
+        items.erase(items.begin() + 1);
+        memory.beginCollection(MemoryManager::Collection::Full);
+        memory.mark(root);
+        memory.collectGarbage();
+        BOOST_CHECK_EQUAL(Counted::instances, 70002);
+
+        memory.clear();
+        BOOST_CHECK_EQUAL(Counted::instances, 0);
+    }
+}
+
+
+BOOST_AUTO_TEST_CASE(compaction_moves_survivors_together)
+{
+    MemoryManager memory;
+    obj::Allocated * root = newList(memory);
+    for(int i = 0; i < 20000; i++) append(static_cast<obj::List *>(root), memory.make<Counted>());
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+
+    // Leave holes between the survivors
+    const auto keepEvery = [&](size_t n) {
+        auto & items = static_cast<obj::List *>(root)->mItems;
+        std::vector<Object> kept;
+        for(size_t i = 0; i < items.size(); i += n) kept.push_back(items[i]);
+        items = kept;
+    };
+    keepEvery(4);
+    const auto reserved = memory.reserved();
+    memory.beginCollection(MemoryManager::Collection::Compact);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 5000);
+    BOOST_CHECK_LT(memory.reserved(), reserved);
+
+    // Items follow each other, except where a page is full
+    const auto & items = static_cast<obj::List *>(root)->mItems;
+    size_t adjacent = 0;
+    for(size_t i = 1; i < items.size(); i++) {
+        const auto previous = reinterpret_cast<char *>(items[i - 1].as_ptr);
+        if( reinterpret_cast<char *>(items[i].as_ptr) == previous + Arena::granularity ) adjacent++;
+    }
+    BOOST_CHECK_GE(adjacent, items.size() - 1 - items.size() * Arena::granularity / Arena::pageSize - 1);
+
+    // Compacted without being asked once mostly empty
+    memory.setCompaction(true);
+    keepEvery(4);
+    const auto fragmented = memory.reserved();
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1250);
+    BOOST_CHECK_LT(memory.reserved(), fragmented);
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(compaction_leaves_pool_strings_alone)
+{
+    ConstantPool pool;
+    pool.addString(0, "literal");
+    std::vector<Object> data(1);
+    pool.initialize(data);
+    const auto literal = data[0].as_ptr;
+
+    MemoryManager memory;
+    obj::Allocated * root = newList(memory);
+    append(static_cast<obj::List *>(root), literal);
+    for(int i = 0; i < 1000; i++) memory.make<Counted>();
+    memory.beginCollection(MemoryManager::Collection::Compact);
+    memory.mark(root);
+    BOOST_REQUIRE_NO_THROW(memory.collectGarbage());
+
+    const auto & items = static_cast<obj::List *>(root)->mItems;
+    BOOST_REQUIRE_EQUAL(items.size(), 1);
+    BOOST_CHECK_EQUAL(items[0].as_ptr, literal);
+    BOOST_CHECK_EQUAL(static_cast<obj::String *>(literal)->value(), "literal");
+
+    memory.clear();
+}
+
+
+BOOST_AUTO_TEST_CASE(deeply_nested_lists_are_marked)
+{
+    MemoryManager memory;
+    obj::Allocated * root = newList(memory);
+    auto list = static_cast<obj::List *>(root);
+    for(int i = 0; i < 1000000; i++) {
+        const auto child = newList(memory);
+        append(list, child);
+        list = child;
+    }
+    append(list, memory.make<Counted>());
+
+    memory.beginCollection(MemoryManager::Collection::Full);
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1);
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(arena_reuses_memory)
+{
+    Arena arena;
+    const auto a = arena.allocate(40);
+    const auto b = arena.allocate(48);
+    BOOST_CHECK_EQUAL(static_cast<char *>(b) - static_cast<char *>(a), 48);
+
+    // Freed slots are reused first
+    arena.deallocate(a, Arena::sizeClass(40));
+    BOOST_CHECK_EQUAL(arena.allocate(33), a);
+
+    const auto large = arena.allocate(4096);
+    arena.deallocate(large, Arena::sizeClass(4096));
+
+    // Pages survive clear
+    const auto reserved = arena.reserved();
+    arena.clear();
+    for(size_t i = 0; i < Arena::pageSize / 48; i++) arena.allocate(48);
+    BOOST_CHECK_EQUAL(arena.reserved(), reserved);
+}
+
+
+BOOST_AUTO_TEST_CASE(tuples_keep_pointer_elements_alive)
+{
+    MemoryManager memory;
+    const auto type = obj::registerType(obj::Tuple<2>::describe("Pair<Int, Counted>", 0b10));
+    const auto tuple = memory.make<obj::Tuple<2> >(type);
+    tuple->data[0].as_int = 42;
+    tuple->data[1].as_ptr = memory.make<Counted>();
+
+    obj::Allocated * root = tuple;
+    memory.beginCollection();
+    memory.mark(root);
+    memory.collectGarbage();
+    BOOST_CHECK_EQUAL(Counted::instances, 1);
+    BOOST_CHECK_EQUAL(static_cast<obj::Tuple<2> *>(root)->data[0].as_int, 42);
+
+    // Registering the same type again yields the same index
+    BOOST_CHECK_EQUAL(obj::registerType(obj::Tuple<2>::describe("Pair<Int, Counted>", 0b10)), type);
+
+    memory.clear();
+    BOOST_CHECK_EQUAL(Counted::instances, 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(line_reader_splits_like_getline)
+{
+    // Lines longer than a block, more lines than a batch and empty input included
+    const std::string longLine(200000, 'x');
+    std::string manyLines;
+    for(int i = 0; i < 10000; i++) manyLines += std::to_string(i) + "\n";
+    for(const auto & input : std::vector<std::string> {"", "a", "a\n", "a\n\nb", "\n\n", longLine + "\n" + longLine, "b\n" + longLine + "\n", manyLines}) {
+        std::stringstream expectedStream(input);
+        std::vector<std::string> expected;
+        while( ! expectedStream.eof() ) {
+            std::string line;
+            std::getline(expectedStream, line);
+            expected.push_back(line);
+        }
+
+        // On the calling thread and on a thread reading ahead
+        for(const size_t numBatches : {0, 2}) {
+            std::stringstream stream(input);
+            LineReader reader(stream);
+            reader.setReadAhead(numBatches);
+            std::vector<std::string> lines;
+            std::string_view line;
+            while( reader.next(line) ) lines.emplace_back(line);
+            BOOST_CHECK(lines == expected);
+            BOOST_CHECK( ! reader.next(line));
+        }
+    }
+
+    // Stops reading ahead when the reader goes away early
+    std::stringstream stream(manyLines);
+    LineReader reader(stream);
+    reader.setReadAhead(2);
+    std::string_view line;
+    BOOST_CHECK(reader.next(line));
+    BOOST_CHECK_EQUAL(line, "0");
+}
+
+
+BOOST_AUTO_TEST_CASE(output_writer_buffers_lines)
+{
+    std::stringstream stream;
+    OutputWriter writer(stream);
+    writer.printLine(INT64_MIN);
+    writer.printLine(0);
+    writer.printLine("text");
+    BOOST_CHECK(stream.str().empty());
+
+    // Lines longer than the buffer bypass it
+    const std::string longLine(100000, 'x');
+    writer.printLine(longLine);
+    writer.printLine(INT64_MAX);
+    writer.flush();
+    BOOST_CHECK_EQUAL(stream.str(), "-9223372036854775808\n0\ntext\n" + longLine + "\n9223372036854775807\n");
+
+    // Every line reaches the stream at once when line buffered
+    stream.str("");
+    writer.setLineBuffered(true);
+    writer.printLine(1);
+    BOOST_CHECK_EQUAL(stream.str(), "1\n");
+    writer.printLine("text");
+    BOOST_CHECK_EQUAL(stream.str(), "1\ntext\n");
+}
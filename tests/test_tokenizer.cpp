@@ -79,6 +79,26 @@ BOOST_AUTO_TEST_CASE(test_full_program)
     BOOST_CHECK_EQUAL(tokens[19].type, Token::ParenRight);
 }
 
+BOOST_AUTO_TEST_CASE(test_range)
+{
+    const std::string program {"0..n 1.5 a..10"};
+
+    Tokenizer tokenizer;
+    const auto tokens = tokenizer.tokenize(program);
+    BOOST_REQUIRE_EQUAL(tokens.size(), 7);
+    BOOST_CHECK_EQUAL(tokens[0].type, Token::IntLiteral);
+    BOOST_CHECK_EQUAL(tokens[0].value, "0");
+    BOOST_CHECK_EQUAL(tokens[1].type, Token::Range);
+    BOOST_CHECK_EQUAL(tokens[1].position.column, 2);
+    BOOST_CHECK_EQUAL(tokens[2].type, Token::Name);
+    BOOST_CHECK_EQUAL(tokens[3].type, Token::FloatLiteral);
+    BOOST_CHECK_EQUAL(tokens[3].value, "1.5");
+    BOOST_CHECK_EQUAL(tokens[4].type, Token::Name);
+    BOOST_CHECK_EQUAL(tokens[5].type, Token::Range);
+    BOOST_CHECK_EQUAL(tokens[6].type, Token::IntLiteral);
+    BOOST_CHECK_EQUAL(tokens[6].value, "10");
+}
+
 BOOST_AUTO_TEST_CASE(test_function_without_args)
 {
     const std::string program {"print()"};